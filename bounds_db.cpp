@@ -0,0 +1,167 @@
+#include "bounds_db.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fstream>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr const char *BoundsDB::default_filename;
+
+// The values of t(n,k) that were settled before the log existed; -1 where
+// the row is known only in part. Every BoundsDB starts from these, so they
+// aren't written to the file.
+static const std::vector<std::vector<int>>& known_values()
+{
+    static constexpr int X = -1;
+    static const std::vector<std::vector<int>> known = {
+        {0},
+        {0, 0},
+        {0, 1, 0},
+        {0, 2, 2, 0},
+        {0, 2, 3, 3, 0},
+        {0, 3, 4, 4, 4, 0},
+        {0, 3, 5, 5, 5, 5, 0},
+        {0, 3, 6, 6, 6, 6, 6, 0},
+        {0, 3, 6, 7, 7, 7, 7, 7, 0},
+        {0, 4, 7, 8, 8, 8, 8, 8, 8, 0},
+        {0, 4, 7, 9, 9, 9, 9, 9, 9, 9, 0},
+        {0, 4, 8,10,10,10,10,10,10,10,10, 0},
+        {0, 4, 8,11,11,11,11,11,11,11,11,11, 0},
+        {0, 4, 8,12,12,12,12,12,12,12,12,12,12, 0},
+        {0, 4, 9, X,13,13,13,13,13,13,13,13,13,13, 0},
+        {0, 4, 9, X,14,14,14,14,14,14,14,14,14,14,14, 0},
+        {0, 4, X, X, X,15,15,15,15,15,15,15,15,15,15,15, 0},
+        {0, 5, X, X, X,16,16,16,16,16,16,16,16,16,16,16,16, 0},
+        {0, 5, X, X, X, X,17,17,17,17,17,17,17,17,17,17,17,17, 0},
+        {0, 5, X, X, X, X,18,18,18,18,18,18,18,18,18,18,18,18,18, 0},
+        {0, 5, X, X, X, X, X,19,19,19,19,19,19,19,19,19,19,19,19,19, 0},
+    };
+    return known;
+}
+
+BoundsDB::BoundsDB(std::string filename) : filename_(std::move(filename))
+{
+    for (auto&& row : known_values()) {
+        assert(row.size() == entries_.size() + 1);
+        entries_.emplace_back(row.size(), Bounds{0, INT_MAX});
+        for (size_t k = 0; k < row.size(); ++k) {
+            if (row[k] >= 0) {
+                entries_.back()[k] = Bounds{row[k], row[k]};
+            }
+        }
+    }
+    std::ifstream infile(filename_);
+    std::string line;
+    while (std::getline(infile, line)) {
+        if (infile.eof()) {
+            // The last line has no trailing newline; we must have crashed halfway through writing it.
+            break;
+        }
+        apply_line(line);
+    }
+}
+
+void BoundsDB::apply_line(const std::string& line)
+{
+    int n, k, t;
+    char op[3] = {};
+    int pos = 0;
+    if (line.empty() || line[0] == '#') {
+        return;
+    } else if (sscanf(line.c_str(), "t(%d,%d) %2s %d%n", &n, &k, op, &t, &pos) != 4 || line[pos] != '\0' ||
+               n < 0 || k < 0 || k > n) {
+        // Anything after the number, such as a record written straight after
+        // a truncated one, means we can't trust the number either.
+        fprintf(stderr, "%s: ignoring malformed line '%s'\n", filename_.c_str(), line.c_str());
+        return;
+    }
+    while (int(entries_.size()) <= n) {
+        entries_.emplace_back(entries_.size() + 1, Bounds{0, INT_MAX});
+    }
+    Bounds& b = entries_[n][k];
+    if (strcmp(op, ">") == 0) {
+        b.min_t = std::max(b.min_t, t + 1);
+    } else if (strcmp(op, "<=") == 0) {
+        b.max_t = std::min(b.max_t, t);
+    } else {
+        fprintf(stderr, "%s: ignoring malformed line '%s'\n", filename_.c_str(), line.c_str());
+    }
+}
+
+void BoundsDB::append_line(const std::string& line)
+{
+    int fd = open(filename_.c_str(), O_RDWR | O_APPEND | O_CREAT, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", filename_.c_str(), strerror(errno));
+        return;
+    }
+    // If we crashed halfway through the last line, finish it off first, so
+    // that this one isn't glued onto it; the mark keeps the loader from
+    // reading what's left of it as a bound, which might be a false one.
+    std::string data = line + '\n';
+    struct stat st;
+    char last;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && pread(fd, &last, 1, st.st_size - 1) == 1 && last != '\n') {
+        data = " # truncated\n" + data;
+    }
+    ssize_t rc = write(fd, data.data(), data.size());
+    if (rc != ssize_t(data.size())) {
+        fprintf(stderr, "%s: short write\n", filename_.c_str());
+    }
+    fsync(fd);
+    close(fd);
+}
+
+const BoundsDB::Bounds *BoundsDB::find(int n, int k) const
+{
+    if (n < 0 || n >= int(entries_.size()) || k < 0 || k > n) return nullptr;
+    return &entries_[n][k];
+}
+
+int BoundsDB::lower_bound(int n, int k) const
+{
+    std::lock_guard<std::mutex> lk(mtx_);
+    const Bounds *b = find(n, k);
+    return b ? b->min_t : 0;
+}
+
+int BoundsDB::upper_bound(int n, int k) const
+{
+    std::lock_guard<std::mutex> lk(mtx_);
+    const Bounds *b = find(n, k);
+    return b ? b->max_t : INT_MAX;
+}
+
+int BoundsDB::rows() const
+{
+    std::lock_guard<std::mutex> lk(mtx_);
+    return entries_.size();
+}
+
+void BoundsDB::report_negative_result(int n, int k, int t)
+{
+    std::lock_guard<std::mutex> lk(mtx_);
+    const Bounds *b = find(n, k);
+    if (b == nullptr || b->min_t < t + 1) {
+        std::string line = "t(" + std::to_string(n) + "," + std::to_string(k) + ") > " + std::to_string(t);
+        apply_line(line);
+        append_line(line);
+    }
+}
+
+void BoundsDB::report_positive_result(int n, int k, int t)
+{
+    std::lock_guard<std::mutex> lk(mtx_);
+    const Bounds *b = find(n, k);
+    if (b == nullptr || t < b->max_t) {
+        std::string line = "t(" + std::to_string(n) + "," + std::to_string(k) + ") <= " + std::to_string(t);
+        apply_line(line);
+        append_line(line);
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+// An append-only log of everything we've proven about t(n,k), shared by st, mt,
+// and wolfy. Each line of the file is either "t(n,k) > t" (a negative result:
+// k wolves among n sheep can't be found in t tests) or "t(n,k) <= t" (a positive
+// result). Lines are appended with a single write(2) and fsync'ed, so a crash can
+// at worst leave one truncated line at the end. The loader ignores it, and the
+// next append marks it as truncated and starts a fresh line, so that it's
+// rejected as malformed rather than read as a bound. The values settled before
+// there was a log are built in, so every program starts from them.
+
+struct BoundsDB {
+    static constexpr const char *default_filename = "wolves-bounds.txt";
+
+    explicit BoundsDB(std::string filename);
+
+    // The smallest t not yet ruled out for (n,k); 0 if we know nothing.
+    int lower_bound(int n, int k) const;
+
+    // The smallest t known to work for (n,k); INT_MAX if we know nothing.
+    int upper_bound(int n, int k) const;
+
+    // One more than the largest n we know anything about.
+    int rows() const;
+
+    // Record a result, if it tells us something we didn't already know.
+    void report_negative_result(int n, int k, int t);
+    void report_positive_result(int n, int k, int t);
+
+private:
+    struct Bounds {
+        int min_t;
+        int max_t;
+    };
+
+    const Bounds *find(int n, int k) const;
+    void apply_line(const std::string& line);
+    void append_line(const std::string& line);
+
+    mutable std::mutex mtx_;
+    std::string filename_;
+    std::vector<std::vector<Bounds>> entries_;
+};
@@ -0,0 +1,116 @@
+#include "canonical_form.h"
+
+#include <cassert>
+
+#include <nauty.h>
+
+// Set this either way; the result should be identical.
+#define ROWSFIRST 0
+
+// The graph is m setwords for each of n vertices, stored in whole uint64_t's.
+static size_t graph_words_needed(int m, int n)
+{
+    return (size_t(m) * n * sizeof(graph) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+}
+
+void NautyWorkspace::reserve(int rows, int cols)
+{
+    const int n = rows + cols;
+    graph_words.reserve(graph_words_needed(SETWORDSNEEDED(n), n));
+    lab.reserve(n);
+    ptn.reserve(n);
+    orbits.reserve(n);
+}
+
+TestMatrix canonicalize_with_nauty(const TestMatrix& matrix)
+{
+    NautyWorkspace workspace;
+    return canonicalize_with_nauty(matrix, workspace);
+}
+
+TestMatrix canonicalize_with_nauty(const TestMatrix& matrix, NautyWorkspace& workspace)
+{
+    const int rows = matrix.num_tests();
+    const int cols = matrix.num_animals();
+    if (rows == 0 || cols == 0) {
+        // There's nothing to permute, and no color classes to give nauty.
+        return matrix;
+    }
+
+    const int n = rows + cols;
+    const int m = SETWORDSNEEDED(n);
+    nauty_check(WORDSIZE, m, n, NAUTYVERSIONID);
+    static_assert(alignof(graph) <= alignof(uint64_t), "graph_words must be suitably aligned for nauty's graph");
+
+#if ROWSFIRST
+    auto v_of_row = [&](int i) { assert(0 <= i && i < rows); return i; };
+    auto v_of_col = [&](int j) { assert(0 <= j && j < cols); return rows + j; };
+    auto row_of_v = [&](int vi) { assert(0 <= vi && vi < rows); return vi; };
+    auto col_of_v = [&](int vj) { assert(rows <= vj && vj < n); return vj - rows; };
+#else
+    auto v_of_row = [&](int i) { assert(0 <= i && i < rows); return cols + i; };
+    auto v_of_col = [&](int j) { assert(0 <= j && j < cols); return j; };
+    auto row_of_v = [&](int vi) { assert(cols <= vi && vi < n); return vi - cols; };
+    auto col_of_v = [&](int vj) { assert(0 <= vj && vj < cols); return vj; };
+#endif
+
+    workspace.graph_words.assign(graph_words_needed(m, n), 0);
+    graph *g = reinterpret_cast<graph *>(workspace.graph_words.data());
+    EMPTYGRAPH(g, m, n);
+
+    for (int i = 0; i < rows; ++i) {
+        for (int j = 0; j < cols; ++j) {
+            if (matrix.test_contains_animal(i, j)) {
+                ADDONEEDGE(g, v_of_row(i), v_of_col(j), m);
+            }
+        }
+    }
+
+    // Add a labeling/coloring to distinguish the "rows" vertices from the "cols" vertices.
+    // Nauty produces different canonicalizations for K_{red,blue} versus K_{blue,red},
+    // so in our labeling we ALWAYS color the "rows" vertices red and the "cols" vertices blue,
+    // never vice versa.
+    workspace.lab.resize(n);
+    workspace.ptn.resize(n);
+    int *lab = workspace.lab.data();
+    int *ptn = workspace.ptn.data();
+
+    for (int i=0; i < n; ++i) ptn[i] = 1;
+    ptn[rows-1] = 0;  // "rows" red vertices
+    ptn[n-1] = 0;  // followed by "cols" blue vertices
+
+    for (int i=0; i < rows; ++i) { lab[i] = v_of_row(i); }
+    for (int j=0; j < cols; ++j) { lab[rows + j] = v_of_col(j); }
+
+    // Nauty's "options.getcanon" is a red herring. We don't want a brand-new graph;
+    // what we want is a canonical labeling of our existing graph's vertices.
+    DEFAULTOPTIONS_GRAPH(options);
+    options.defaultptn = false;
+
+    workspace.orbits.resize(n);
+    int *orbits = workspace.orbits.data();
+    statsblk stats;
+    densenauty(g, lab, ptn, orbits, &options, &stats, m, n, nullptr);
+    assert(stats.errstatus == 0);
+
+    // Convert the canonicalized graph back to a txn matrix.
+    // We need to look at the labeling, which is now a permutation
+    // of our original vertices.
+    assert(ptn[rows-1] == 0);
+    assert(ptn[n-1] == 0);
+
+    TestMatrix result(rows, cols);
+
+    for (int i=0; i < rows; ++i) {
+        for (int j=0; j < cols; ++j) {
+            int vi = lab[i];
+            int vj = lab[rows + j];
+            bool a = ISELEMENT(&g[vi*m], vj);
+            bool b = ISELEMENT(&g[vj*m], vi);
+            assert(a == b);
+            result.set(i, j, a);
+        }
+    }
+
+    return result;
+}
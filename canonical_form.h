@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "test_matrix.h"
+
+// nauty's graph and labelling arrays, kept from one call to the next and
+// grown to fit the largest matrix so far, so that canonicalizing a stream of
+// matrices doesn't allocate them afresh for each one. Only one thread at a
+// time may use a workspace; and for several threads to call nauty at once,
+// nauty itself must have been built thread-safe (configured with --enable-tls).
+struct NautyWorkspace {
+    std::vector<uint64_t> graph_words;
+    std::vector<int> lab;
+    std::vector<int> ptn;
+    std::vector<int> orbits;
+
+    // Make room for a matrix of this many rows and columns now, rather than later.
+    void reserve(int rows, int cols);
+};
+
+// The canonical form of a matrix of tests under permuting its rows and its
+// columns, computed by nauty: two matrices are permutations of each other if
+// and only if their canonical forms are identical.
+TestMatrix canonicalize_with_nauty(const TestMatrix& matrix, NautyWorkspace& workspace);
+TestMatrix canonicalize_with_nauty(const TestMatrix& matrix);
@@ -1,132 +1,181 @@
 #include <algorithm>
-#include <cassert>
+#include <atomic>
 #include <iostream>
 #include <iterator>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <string>
+#include <thread>
 #include <vector>
 
-#include <nauty.h>
+#include "canonical_form.h"
+#include "solution_file.h"
+#include "test_matrix.h"
 
-// Set this either way; the result should be identical.
-#define ROWSFIRST 0
-
-std::vector<std::string> canonicalize_with_nauty(std::vector<std::string> lines)
+// Rows and columns are shuffled by permuting these two orders;
+// the matrix itself is rebuilt only once, at the end.
+TestMatrix shuffle_for_prettiness(const TestMatrix& matrix)
 {
-    const int rows = lines.size();
-    const int cols = lines[0].size();
-    for (auto&& line : lines) assert(line.size() == cols);
-
-    const int n = rows + cols;
-    const int m = SETWORDSNEEDED(n);
-    nauty_check(WORDSIZE, m, n, NAUTYVERSIONID);
-
-#if ROWSFIRST
-    auto v_of_row = [&](int i) { assert(0 <= i && i < rows); return i; };
-    auto v_of_col = [&](int j) { assert(0 <= j && j < cols); return rows + j; };
-    auto row_of_v = [&](int vi) { assert(0 <= vi && vi < rows); return vi; };
-    auto col_of_v = [&](int vj) { assert(rows <= vj && vj < n); return vj - rows; };
-#else
-    auto v_of_row = [&](int i) { assert(0 <= i && i < rows); return cols + i; };
-    auto v_of_col = [&](int j) { assert(0 <= j && j < cols); return j; };
-    auto row_of_v = [&](int vi) { assert(cols <= vi && vi < n); return vi - cols; };
-    auto col_of_v = [&](int vj) { assert(0 <= vj && vj < cols); return vj; };
-#endif
-
-    DYNALLSTAT(graph, g, g_sz); DYNALLOC2(graph, g, g_sz, m, n, "malloc");
-    EMPTYGRAPH(g, m, n);
+    const int rows = matrix.num_tests();
+    const int cols = matrix.num_animals();
+    std::vector<int> row_order(rows);
+    std::vector<int> col_order(cols);
+    for (int r = 0; r < rows; ++r) row_order[r] = r;
+    for (int c = 0; c < cols; ++c) col_order[c] = c;
+
+    auto is_one = [&](int row, int c) { return matrix.test_contains_animal(row, col_order[c]); };
+    // The length of the last run of ones in the row.
+    auto trailing_ones = [&](int row) {
+        int c = cols - 1;
+        while (c >= 0 && !is_one(row, c)) --c;
+        int end = c;
+        while (c >= 0 && is_one(row, c)) --c;
+        return end - c;
+    };
+    // Compare rows as strings of '1' and '.', in which '1' is the greater.
+    auto lexicographically_greater = [&](int a, int b) {
+        for (int c = 0; c < cols; ++c) {
+            if (is_one(a, c) != is_one(b, c)) return is_one(a, c);
+        }
+        return false;
+    };
+    auto by_trailing_ones = [&](int a, int b) { return trailing_ones(a) > trailing_ones(b); };
 
-    for (int i = 0; i < rows; ++i) {
-        for (int j = 0; j < cols; ++j) {
-            if (lines[i][j] == '1') {
-                ADDONEEDGE(g, v_of_row(i), v_of_col(j), m);
+    for (int iter = 0; iter < 10; ++iter) {
+        std::stable_sort(row_order.begin(), row_order.end(), lexicographically_greater);
+        std::stable_sort(row_order.begin(), row_order.end(), by_trailing_ones);
+        // The first column of a pair gets priority. Bubble-sort.
+        for (int iter = 0; iter < cols; ++iter) {
+            for (int c = cols-2; c >= 0; --c) {
+                for (int r=0; r < rows; ++r) {
+                    if (is_one(row_order[r], c) != is_one(row_order[r], c+1)) {
+                        if (is_one(row_order[r], c+1)) {
+                            std::swap(col_order[c], col_order[c+1]);
+                        }
+                        break;
+                    }
+                }
             }
         }
     }
 
-    // Add a labeling/coloring to distinguish the "rows" vertices from the "cols" vertices.
-    // Nauty produces different canonicalizations for K_{red,blue} versus K_{blue,red},
-    // so in our labeling we ALWAYS color the "rows" vertices red and the "cols" vertices blue,
-    // never vice versa.
-    DYNALLSTAT(int, lab, lab_sz); DYNALLOC1(int, lab, lab_sz, n, "malloc");
-    DYNALLSTAT(int, ptn, ptn_sz); DYNALLOC1(int, ptn, ptn_sz, n, "malloc");
-
-    for (int i=0; i < n; ++i) ptn[i] = 1;
-    ptn[rows-1] = 0;  // "rows" red vertices
-    ptn[n-1] = 0;  // followed by "cols" blue vertices
-
-    for (int i=0; i < rows; ++i) { lab[i] = v_of_row(i); }
-    for (int j=0; j < cols; ++j) { lab[rows + j] = v_of_col(j); }
-
-    // Nauty's "options.getcanon" is a red herring. We don't want a brand-new graph;
-    // what we want is a canonical labeling of our existing graph's vertices.
-    DEFAULTOPTIONS_GRAPH(options);
-    options.defaultptn = false;
-
-    DYNALLSTAT(int, orbits, orbits_sz); DYNALLOC1(int, orbits, orbits_sz, n, "malloc");
-    statsblk stats;
-    densenauty(g, lab, ptn, orbits, &options, &stats, m, n, nullptr);
-    assert(stats.errstatus == 0);
-
-    // Convert the canonicalized graph back to a txn matrix.
-    // We need to look at the labeling, which is now a permutation
-    // of our original vertices.
-    assert(ptn[rows-1] == 0);
-    assert(ptn[n-1] == 0);
-
-    for (int i=0; i < rows; ++i) {
-        for (int j=0; j < cols; ++j) {
-            int vi = lab[i];
-            int vj = lab[rows + j];
-            bool a = ISELEMENT(&g[vi*m], vj);
-            bool b = ISELEMENT(&g[vj*m], vi);
-            assert(a == b);
-            lines[i][j] = (a ? '1' : '.');
+    TestMatrix result(rows, cols);
+    for (int r = 0; r < rows; ++r) {
+        for (int c = 0; c < cols; ++c) {
+            result.set(r, c, is_one(row_order[r], c));
         }
     }
+    return result;
+}
 
-    return lines;
+// A hash of a canonical form, for spotting duplicates: any two matrices that
+// are permutations of each other hash alike. It's FNV-1a over the dimensions
+// and the rows' words, byte by byte, so it's the same on every machine.
+static uint64_t hash_of_canonical_form(const TestMatrix& matrix)
+{
+    uint64_t h = 0xcbf29ce484222325uLL;
+    auto add = [&](uint64_t w) {
+        for (int b = 0; b < 8; ++b) {
+            h = (h ^ ((w >> (8 * b)) & 0xff)) * 0x100000001b3uLL;
+        }
+    };
+    add(matrix.num_tests());
+    add(matrix.num_animals());
+    for (int r = 0; r < matrix.num_tests(); ++r) {
+        for (int w = 0; w < matrix.words_per_row(); ++w) {
+            add(matrix.row(r)[w]);
+        }
+    }
+    return h;
 }
 
-std::vector<std::string> shuffle_for_prettiness(std::vector<std::string> lines)
+// Read every record of a solution file, canonicalize them all across this
+// many threads, and print them back out in the same order and format, each
+// with its hash. Records are read up front so that each thread's workspace
+// can be sized to the largest of them once.
+static void canonicalize_records(bool pretty, int num_threads)
 {
-    const int rows = lines.size();
-    const int cols = lines[0].size();
+    std::vector<SolutionRecord> records;
+    read_solution_records(std::cin, [&](SolutionRecord&& r) { records.push_back(std::move(r)); });
+    int max_rows = 0;
+    int max_cols = 0;
+    for (auto&& r : records) {
+        max_rows = std::max(max_rows, r.t);
+        max_cols = std::max(max_cols, r.n);
+    }
 
-    auto is_one = [&](char ch) { return ch == '1'; };
-    auto trailing_ones = [&](const auto& a) {
-        auto it1 = std::find_if(a.rbegin(), a.rend(), is_one);
-        auto it2 = std::find_if_not(it1, a.rend(), is_one);
-        return it2 - it1;
-    };
-    auto by_trailing_ones = [&](const auto& a, const auto& b) { return trailing_ones(a) > trailing_ones(b); };
-    auto swap_columns = [&](int i, int j) {
-        for (auto& line : lines) {
-            std::swap(line[i], line[j]);
+    std::vector<uint64_t> hashes(records.size());
+    std::atomic<size_t> next_record(0);
+    auto work = [&]() {
+        NautyWorkspace workspace;
+        workspace.reserve(max_rows, max_cols);
+        for (size_t i; (i = next_record++) < records.size(); ) {
+            TestMatrix& matrix = records[i].tests;
+            matrix = canonicalize_with_nauty(matrix, workspace);
+            hashes[i] = hash_of_canonical_form(matrix);
+            if (pretty) {
+                matrix = shuffle_for_prettiness(matrix);
+            }
         }
     };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_threads; ++i) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto&& th : threads) {
+        th.join();
+    }
 
-    for (int iter = 0; iter < 10; ++iter) {
-        std::stable_sort(lines.begin(), lines.end(), std::greater<>());
-        std::stable_sort(lines.begin(), lines.end(), by_trailing_ones);
-        // The first column of a pair gets priority. Bubble-sort.
-        for (int iter = 0; iter < cols; ++iter) {
-            for (int c = cols-1; c >= 0; --c) {
-                for (int r=0; r < rows; ++r) {
-                    if (lines[r][c] != lines[r][c+1]) {
-                        if (is_one(lines[r][c+1])) {
-                            swap_columns(c, c+1);
-                        }
-                        break;
-                    }
-                }
-            }
+    for (size_t i = 0; i < records.size(); ++i) {
+        const SolutionRecord& r = records[i];
+        char hash[17];
+        snprintf(hash, sizeof hash, "%016llx", (unsigned long long)hashes[i]);
+        std::cout << "N=" << r.n << " D=" << r.d << " T=" << r.t << " guaranteed_best=" << (r.guaranteed_best ? 1 : 0)
+                  << " hash=" << hash << "\n";
+        for (int row = 0; row < r.tests.num_tests(); ++row) {
+            std::cout << r.tests.row_string(row) << "\n";
         }
+        std::cout << "\n";
     }
-    return lines;
 }
 
-int main()
+static void print_usage()
+{
+    fprintf(stderr, "Usage: ./cm < matrix.txt\n");
+    fprintf(stderr, "  Print the canonical form of a matrix given as rows of '1's and '.'s.\n");
+    fprintf(stderr, "       ./cm --records [--threads N] [--pretty] < wolfy-out.txt\n");
+    fprintf(stderr, "  Canonicalize every record of a solution file, printing each one back out\n");
+    fprintf(stderr, "  with a hash of its canonical form; equivalent strategies hash alike.\n");
+    fprintf(stderr, "  --pretty rearranges each canonical form for reading, as the first form\n");
+    fprintf(stderr, "  always does, at a cost that grows quickly with n. More than one thread\n");
+    fprintf(stderr, "  needs nauty to have been built thread-safe (configured with --enable-tls).\n");
+}
+
+int main(int argc, char **argv)
 {
+    bool records = false;
+    bool pretty = false;
+    int num_threads = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--records") == 0) {
+            records = true;
+        } else if (strcmp(argv[i], "--pretty") == 0) {
+            pretty = true;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc && atoi(argv[i+1]) >= 1) {
+            num_threads = atoi(argv[++i]);
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+    if (records) {
+        canonicalize_records(pretty, num_threads);
+        return 0;
+    }
+
     std::vector<std::string> lines(
         std::istream_iterator<std::string>{std::cin},
         std::istream_iterator<std::string>{}
@@ -135,16 +184,17 @@ int main()
     // This is the foolproof canonicalization step.
     // Every matrix in an equivalence class WILL be mapped
     // onto the same (arbitrary) member of its equivalence class.
-    lines = canonicalize_with_nauty(lines);
+    TestMatrix matrix = TestMatrix::from_strings(lines, lines.empty() ? 0 : lines[0].size());
+    matrix = canonicalize_with_nauty(matrix);
 
     // This is the "pretty-print" step.
     // It takes the arbitrary canonical representation
     // and quickly shuffles rows and columns deterministically
     // to produce a representation that is qualitatively "prettier."
-    lines = shuffle_for_prettiness(lines);
+    matrix = shuffle_for_prettiness(matrix);
 
     // And finally, print out the result.
-    for (auto&& line : lines) {
-        std::cout << line << "\n";
+    for (int r = 0; r < matrix.num_tests(); ++r) {
+        std::cout << matrix.row_string(r) << "\n";
     }
 }
@@ -0,0 +1,103 @@
+#include "checkpoint.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+std::string format_checkpoint(const SolveCheckpoint& checkpoint)
+{
+    std::string data = "checkpoint " + std::to_string(checkpoint.n) + " " + std::to_string(checkpoint.k) + " " +
+        std::to_string(checkpoint.t) + " " + std::to_string(checkpoint.test_population) + " " +
+        std::to_string(checkpoint.isomorph_rejection_depth) + "\n";
+    for (auto&& entry : checkpoint.entries) {
+        data += "entry " + std::to_string(entry.fixed_depth);
+        for (auto&& m : entry.path) {
+            data += " " + m;
+        }
+        data += "\n";
+    }
+    data += "end\n";
+    return data;
+}
+
+bool parse_checkpoint(const std::string& text, SolveCheckpoint *checkpoint)
+{
+    std::istringstream lines(text);
+    std::string line;
+    SolveCheckpoint result;
+    if (!std::getline(lines, line)) {
+        return false;
+    }
+    int pos = 0;
+    if (sscanf(line.c_str(), "checkpoint %d %d %d %d %d%n", &result.n, &result.k, &result.t,
+               &result.test_population, &result.isomorph_rejection_depth, &pos) != 5 || line[pos] != '\0') {
+        return false;
+    }
+    while (std::getline(lines, line)) {
+        if (line == "end") {
+            *checkpoint = std::move(result);
+            return true;
+        }
+        std::istringstream iss(line);
+        std::string word;
+        SolveCheckpoint::Entry entry;
+        if (!(iss >> word >> entry.fixed_depth) || word != "entry" || entry.fixed_depth < 0) {
+            return false;
+        }
+        bool malformed = false;
+        while (iss >> word) {
+            malformed |= (int(word.size()) != result.n || word.find_first_not_of("01") != std::string::npos);
+            entry.path.push_back(word);
+        }
+        if (malformed || int(entry.path.size()) < entry.fixed_depth || int(entry.path.size()) > result.t) {
+            return false;
+        }
+        result.entries.push_back(std::move(entry));
+    }
+    return false;
+}
+
+bool save_checkpoint(const std::string& filename, const SolveCheckpoint& checkpoint)
+{
+    std::string data = format_checkpoint(checkpoint);
+
+    std::string tmpname = filename + ".tmp";
+    int fd = open(tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", tmpname.c_str(), strerror(errno));
+        return false;
+    }
+    ssize_t rc = write(fd, data.data(), data.size());
+    bool ok = (rc == ssize_t(data.size())) && (fsync(fd) == 0);
+    close(fd);
+    if (!ok) {
+        fprintf(stderr, "%s: short write\n", tmpname.c_str());
+        unlink(tmpname.c_str());
+        return false;
+    }
+    if (rename(tmpname.c_str(), filename.c_str()) != 0) {
+        fprintf(stderr, "%s: %s\n", filename.c_str(), strerror(errno));
+        unlink(tmpname.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool load_checkpoint(const std::string& filename, SolveCheckpoint *checkpoint)
+{
+    std::ifstream infile(filename);
+    if (!infile) {
+        return false;
+    }
+    std::stringstream ss;
+    ss << infile.rdbuf();
+    if (!parse_checkpoint(ss.str(), checkpoint)) {
+        fprintf(stderr, "%s: ignoring malformed checkpoint\n", filename.c_str());
+        return false;
+    }
+    return true;
+}
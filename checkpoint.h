@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include "wolves.h"
+
+// A SolveCheckpoint on disk is a text file like
+//
+//   checkpoint 13 3 10 0 0
+//   entry 2 1111000000000 1100110000000 1010101000000
+//   entry 2 1111000000000 1100101100000
+//   end
+//
+// giving n, k, t, test_population and isomorph_rejection_depth, all of which
+// must be there, then each entry's fixed_depth and path.
+// It's written to a temporary file, fsync'ed, and renamed over the old one, so a
+// crash leaves either the old checkpoint or the new one, never a mixture.
+
+std::string format_checkpoint(const SolveCheckpoint& checkpoint);
+bool parse_checkpoint(const std::string& text, SolveCheckpoint *checkpoint);
+
+bool save_checkpoint(const std::string& filename, const SolveCheckpoint& checkpoint);
+
+// Returns false if the file is missing or malformed.
+bool load_checkpoint(const std::string& filename, SolveCheckpoint *checkpoint);
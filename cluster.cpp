@@ -0,0 +1,137 @@
+#include "cluster.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+Connection::~Connection()
+{
+    close(fd_);
+}
+
+bool Connection::send(const std::string& lines)
+{
+    std::lock_guard<std::mutex> lk(write_mtx_);
+    size_t done = 0;
+    while (done < lines.size()) {
+        ssize_t rc = ::send(fd_, lines.data() + done, lines.size() - done, MSG_NOSIGNAL);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        } else if (rc <= 0) {
+            return false;
+        }
+        done += rc;
+    }
+    return true;
+}
+
+Connection::ReadStatus Connection::read_line(std::string *line, int timeout_ms)
+{
+    while (true) {
+        size_t newline = buffer_.find('\n');
+        if (newline != std::string::npos) {
+            *line = buffer_.substr(0, newline);
+            buffer_.erase(0, newline + 1);
+            return Line;
+        }
+        struct pollfd pfd = { fd_, POLLIN, 0 };
+        int rc = poll(&pfd, 1, timeout_ms);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        } else if (rc == 0) {
+            return Timeout;
+        } else if (rc < 0) {
+            return Closed;
+        }
+        char buf[4096];
+        ssize_t n = recv(fd_, buf, sizeof buf, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            return Closed;
+        }
+        buffer_.append(buf, n);
+    }
+}
+
+int listen_on_port(int port)
+{
+    int fd = socket(AF_INET6, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "socket: %s\n", strerror(errno));
+        return -1;
+    }
+    int one = 1;
+    int zero = 0;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof zero);
+    struct sockaddr_in6 addr = {};
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof addr) != 0 || listen(fd, 16) != 0) {
+        fprintf(stderr, "port %d: %s\n", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+std::unique_ptr<Connection> accept_connection(int listen_fd)
+{
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof addr;
+    int fd = accept(listen_fd, (struct sockaddr *)&addr, &len);
+    if (fd < 0) {
+        return nullptr;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    char host[NI_MAXHOST] = "?";
+    char port[NI_MAXSERV] = "?";
+    getnameinfo((struct sockaddr *)&addr, len, host, sizeof host, port, sizeof port, NI_NUMERICHOST | NI_NUMERICSERV);
+    return std::unique_ptr<Connection>(new Connection(fd, std::string(host) + ":" + port));
+}
+
+std::unique_ptr<Connection> connect_to(const std::string& address)
+{
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        fprintf(stderr, "%s: expected host:port\n", address.c_str());
+        return nullptr;
+    }
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *res = nullptr;
+    int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+    if (rc != 0) {
+        fprintf(stderr, "%s: %s\n", address.c_str(), gai_strerror(rc));
+        return nullptr;
+    }
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai != nullptr && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if (fd < 0) {
+        fprintf(stderr, "%s: can't connect\n", address.c_str());
+        return nullptr;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    return std::unique_ptr<Connection>(new Connection(fd, address));
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+// The wire protocol between "mt --listen" (the coordinator) and "mt --connect"
+// (a remote worker) is newline-terminated text.
+//
+//   worker -> coordinator:   HELLO threads
+//                            HEARTBEAT
+//                            CHECKPOINT, then a checkpoint file's lines up to "end"
+//                            MESSAGE text
+//                            POSITIVE n k t | NEGATIVE n k t | INTERRUPTED n k t
+//   coordinator -> worker:   CHECKPOINT ... end   (to resume from, before the TASK)
+//                            TASK n k t
+//                            STOP
+//
+// A worker works on one task at a time. Its lease on that task lasts as long as
+// it keeps sending heartbeats; if they stop, the coordinator assumes the worker
+// is gone and hands the task to someone else.
+
+static constexpr int heartbeat_interval_ms = 10 * 1000;
+static constexpr int lease_timeout_ms = 60 * 1000;
+
+struct Connection {
+    enum ReadStatus { Line, Timeout, Closed };
+
+    explicit Connection(int fd, std::string peer) : fd_(fd), peer_(std::move(peer)) {}
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+    ~Connection();
+
+    const std::string& peer() const { return peer_; }
+
+    // Send one or more complete lines. Safe to call from several threads at once.
+    bool send(const std::string& lines);
+
+    // Wait up to timeout_ms for a complete line, which is returned without its newline.
+    ReadStatus read_line(std::string *line, int timeout_ms);
+
+private:
+    int fd_;
+    std::string peer_;
+    std::string buffer_;
+    std::mutex write_mtx_;
+};
+
+// Return a listening socket, or -1 on failure.
+int listen_on_port(int port);
+
+// Block until someone connects; nullptr on failure.
+std::unique_ptr<Connection> accept_connection(int listen_fd);
+
+// "host:port"; nullptr on failure.
+std::unique_ptr<Connection> connect_to(const std::string& address);
@@ -0,0 +1,96 @@
+#include "combinatorics.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <limits.h>
+#include <vector>
+
+using Int = unsigned long long;
+
+static constexpr int table_rows = 512;
+static constexpr int table_columns = 65;
+
+// C(n, k) for n < table_rows and k < table_columns, saturated. Anything with
+// k <= n/2 that falls outside it is either off the bottom, or at least
+// C(130, 65), which saturates anyway.
+static const std::vector<Int>& pascal_table()
+{
+    static const std::vector<Int> table = []() {
+        std::vector<Int> t(size_t(table_rows) * table_columns, 0);
+        for (int n = 0; n < table_rows; ++n) {
+            t[n * table_columns] = 1;
+            for (int k = 1; k < table_columns && k <= n; ++k) {
+                Int a = t[(n-1) * table_columns + (k-1)];
+                Int b = t[(n-1) * table_columns + k];
+                t[n * table_columns + k] = (a > ULLONG_MAX - b) ? ULLONG_MAX : a + b;
+            }
+        }
+        return t;
+    }();
+    return table;
+}
+
+Int choose_saturated(int n, int k)
+{
+    if (k < 0 || k > n) return Int(0);
+    k = std::min(k, n - k);
+    if (n < table_rows && k < table_columns) {
+        return pascal_table()[n * table_columns + k];
+    }
+    // After step i, result is C(n-k+i, i), so each division is exact; and
+    // those only grow with i, so once one won't fit, neither will the last.
+    Int result = 1;
+    for (int i = 1; i <= k; ++i) {
+        unsigned __int128 quotient = (unsigned __int128)result * (n - k + i) / i;
+        if (quotient > ULLONG_MAX) return ULLONG_MAX;
+        result = Int(quotient);
+    }
+    return result;
+}
+
+Int choose(int n, int k)
+{
+    Int result = choose_saturated(n, k);
+    assert(result != ULLONG_MAX || !"C(n, k) doesn't fit in 64 bits");
+    return result;
+}
+
+void unrank_arrangement(Int rank, int n, int d, int *v)
+{
+    assert(0 <= d && d <= n);
+    assert(rank < choose_saturated(n, d));
+    // The largest wolf is the largest c with C(c, d) <= rank, and so on down;
+    // wolf i is at least i, where C(i, i+1) is 0, and below the wolf above it.
+    int hi = n;
+    for (int i = d-1; i >= 0; --i) {
+        int lo = i;
+        while (hi - lo > 1) {
+            int mid = lo + (hi - lo) / 2;
+            if (choose_saturated(mid, i+1) <= rank) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        v[i] = lo;
+        rank -= choose_saturated(lo, i+1);
+        hi = lo;
+    }
+    assert(rank == 0);
+}
+
+int next_arrangement(int *v, int d, int n)
+{
+    // Move the lowest wolf that can move up by one, and reset the ones below it.
+    for (int i = 0; i < d; ++i) {
+        if (v[i] + 1 < ((i == d-1) ? n : v[i+1])) {
+            v[i] += 1;
+            for (int j = 0; j < i; ++j) {
+                v[j] = j;
+            }
+            return i;
+        }
+    }
+    assert(!"there is no next arrangement");
+    return -1;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+// Binomial coefficients, and the numbering of the arrangements of d wolves
+// among n animals that the solver, the verifiers and the GPU share. An
+// arrangement is its wolves in increasing order, v[0] < v[1] < ... < v[d-1],
+// and they're numbered in colex order: the rank of v is the sum of
+// C(v[i], i+1), so they come in order of their largest wolf, then their next
+// largest, and so on. That's the order next_arrangement() steps through them,
+// so a range of ranks can be started anywhere by unranking its first.
+
+// C(n, k); 0 if k < 0 or k > n. It must fit in 64 bits. For n below 512 it
+// comes from a table built on first use.
+unsigned long long choose(int n, int k);
+
+// C(n, k), or ULLONG_MAX if that won't fit. No rank is that large, so
+// unranking copes with it.
+unsigned long long choose_saturated(int n, int k);
+
+// Fill v[0..d) with the arrangement of n animals with this rank, which must be
+// less than C(n, d). Each wolf is a binary search of the table, so it's
+// O(d log n).
+void unrank_arrangement(unsigned long long rank, int n, int d, int *v);
+
+// Step v[0..d) to the arrangement of n animals with the next rank, and return
+// the index of the wolf that moved; the ones below it are reset to 0, 1, ....
+// v mustn't be the last arrangement.
+int next_arrangement(int *v, int d, int n);
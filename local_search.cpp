@@ -0,0 +1,171 @@
+#include "local_search.h"
+
+#include <assert.h>
+#include <math.h>
+#include <random>
+#include <stdint.h>
+#include <vector>
+
+#include "combinatorics.h"
+
+using Int = unsigned long long;
+
+static uint64_t mix(uint64_t x) { return x * 0x9E3779B97F4A7C15uLL; }
+
+static const uint32_t empty_slot = UINT32_MAX;
+
+namespace {
+
+// How many arrangements have each result vector, in an open-addressing table.
+// A slot keeps its key once its count drops to zero, so that the keys after it
+// can still be found; such dead slots are reused by later insertions, and once
+// three quarters of the slots have been used, the caller rebuilds the table.
+struct ResultCounts {
+    explicit ResultCounts(Int expected) {
+        size_t capacity = 16;
+        while (capacity < 2 * expected) capacity *= 2;
+        keys_.resize(capacity);
+        counts_.resize(capacity, empty_slot);
+    }
+
+    void clear() {
+        std::fill(counts_.begin(), counts_.end(), empty_slot);
+        used_ = 0;
+    }
+
+    bool needs_rebuild() const { return used_ > keys_.size() / 4 * 3; }
+
+    // Returns the count before this one.
+    uint32_t add(uint64_t key) {
+        const size_t mask = keys_.size() - 1;
+        size_t dead = SIZE_MAX;
+        for (size_t h = mix(key) >> 32 & mask; true; h = (h + 1) & mask) {
+            if (counts_[h] == empty_slot) {
+                if (dead == SIZE_MAX) {
+                    dead = h;
+                    used_ += 1;
+                }
+                keys_[dead] = key;
+                counts_[dead] = 1;
+                return 0;
+            } else if (keys_[h] == key) {
+                return counts_[h]++;
+            } else if (counts_[h] == 0 && dead == SIZE_MAX) {
+                dead = h;
+            }
+        }
+    }
+
+    // Returns the count after this one is gone.
+    uint32_t remove(uint64_t key) {
+        const size_t mask = keys_.size() - 1;
+        for (size_t h = mix(key) >> 32 & mask; true; h = (h + 1) & mask) {
+            assert(counts_[h] != empty_slot || !"removing a result that was never added");
+            if (keys_[h] == key && counts_[h] != empty_slot) {
+                assert(counts_[h] != 0);
+                return --counts_[h];
+            }
+        }
+    }
+
+private:
+    std::vector<uint64_t> keys_;
+    std::vector<uint32_t> counts_;
+    size_t used_ = 0;
+};
+
+struct Annealer {
+    int n, d;
+    std::vector<uint64_t> cols;
+    ResultCounts counts;
+    Int cost = 0;
+
+    explicit Annealer(const TestMatrix& tests, int d) :
+        n(tests.num_animals()), d(d), counts(choose(tests.num_animals(), d))
+    {
+        for (int j = 0; j < n; ++j) {
+            cols.push_back(tests.column(j)[0]);
+        }
+        rebuild();
+    }
+
+    // Call f(results) for each way of choosing wolves_left more wolves from
+    // [first, n), other than skip, whose tests together with results don't
+    // touch stop_bits.
+    template<class F>
+    void for_each_arrangement(int first, int wolves_left, uint64_t results, int skip, uint64_t stop_bits, const F& f) {
+        if (wolves_left == 0) {
+            f(results);
+            return;
+        }
+        for (int a = first; a <= n - wolves_left; ++a) {
+            uint64_t r = results | cols[a];
+            if (a != skip && (r & stop_bits) == 0) {
+                for_each_arrangement(a + 1, wolves_left - 1, r, skip, stop_bits, f);
+            }
+        }
+    }
+
+    void rebuild() {
+        counts.clear();
+        cost = 0;
+        for_each_arrangement(0, d, 0, -1, 0, [&](uint64_t results) {
+            cost += counts.add(results);
+        });
+    }
+
+    // Flip test r of animal j, and return the change in cost.
+    long long flip(int r, int j) {
+        const uint64_t bit = uint64_t(1) << r;
+        const uint64_t old_col = cols[j];
+        const uint64_t new_col = old_col ^ bit;
+        long long delta = 0;
+        for_each_arrangement(0, d - 1, 0, j, bit, [&](uint64_t others) {
+            delta -= counts.remove(others | old_col);
+            delta += counts.add(others | new_col);
+        });
+        cols[j] = new_col;
+        cost += delta;
+        return delta;
+    }
+};
+
+} // anonymous namespace
+
+AnnealResult anneal_to_separable(TestMatrix *tests, int d, const AnnealOptions& options)
+{
+    const int t = tests->num_tests();
+    const int n = tests->num_animals();
+    assert(t <= 64);
+    assert(1 <= d && d <= n);
+    if (t == 0) {
+        return AnnealResult{choose(n, d) <= 1, 0, choose(n, d) * (choose(n, d) - 1) / 2};
+    }
+
+    Annealer state(*tests, d);
+    std::vector<uint64_t> best = state.cols;
+    Int best_cost = state.cost;
+    std::mt19937_64 rng(options.seed);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    const double cooling = log(options.final_temperature / options.initial_temperature);
+
+    unsigned long long flips = 0;
+    for ( ; flips < options.max_flips && state.cost != 0; ++flips) {
+        const double temperature = options.initial_temperature * exp(cooling * flips / options.max_flips);
+        const int r = rng() % t;
+        const int j = rng() % n;
+        long long delta = state.flip(r, j);
+        if (delta > 0 && coin(rng) >= exp(-delta / temperature)) {
+            state.flip(r, j);
+        } else if (state.cost < best_cost) {
+            best = state.cols;
+            best_cost = state.cost;
+        }
+        if (state.counts.needs_rebuild()) {
+            state.rebuild();
+        }
+    }
+
+    *tests = TestMatrix::from_columns(best.data(), t, n);
+    return AnnealResult{best_cost == 0, flips, best_cost};
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include "test_matrix.h"
+
+// Simulated annealing over matrices of a fixed size, looking for one that is
+// d-separable: no two arrangements of d wolves give the same test results.
+// A matrix costs the number of pairs of arrangements that collide, and a move
+// flips one entry. That changes only the results of the arrangements including
+// that animal, and only in that test, so only those are looked at; and any
+// arrangement with another wolf already in that test is skipped along with
+// every arrangement that extends it. The result of every arrangement is
+// counted in a hash table of about 24 bytes per arrangement, so this is for
+// cells where C(n,d) is in the hundreds of millions at most.
+
+struct AnnealOptions {
+    // Give up after trying this many moves.
+    unsigned long long max_flips = 1000000;
+    uint64_t seed = 0;
+    // A move that adds c colliding pairs is taken with probability exp(-c/T),
+    // where T falls geometrically from the first to the second over max_flips.
+    double initial_temperature = 2.0;
+    double final_temperature = 0.05;
+};
+
+struct AnnealResult {
+    bool success;
+    unsigned long long flips;       // moves tried
+    unsigned long long collisions;  // colliding pairs left; 0 on success
+};
+
+// The matrix must have at most 64 tests. On success it's left d-separable;
+// otherwise it's left as the matrix with the fewest collisions seen.
+AnnealResult anneal_to_separable(TestMatrix *tests, int d, const AnnealOptions& options);
@@ -0,0 +1,246 @@
+#include <assert.h>
+#include <chrono>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include "wolves.h"
+
+// A fixed corpus of workloads, so that a change to the solver, the verifier or
+// wolfy can be compared against the commit before it. Each workload runs in a
+// child process of its own, so that its wall time and peak RSS are its alone.
+// The solver cells run single-threaded, and bn is built with -DWOLVES_STATS
+// so that they can say how many nodes they visited; every one of them has to
+// search, rather than be answered by solve_wolves' shortcuts.
+
+struct Workload {
+    const char *name;
+    bool full_only;   // a solver cell that takes many minutes
+    // For a solver cell:
+    int n, k, t;
+    bool expected;
+    // For a verifier workload, the strategy name passed to ./vs;
+    // for the wolfy pass, nullptr with n == 0.
+    const char *strategy;
+};
+
+static const Workload corpus[] = {
+    { "solve_10_3_8",   false, 10, 3,  8, false, nullptr },
+    { "solve_11_3_9",   false, 11, 3,  9, false, nullptr },
+    { "solve_12_2_8",   false, 12, 2,  8, true,  nullptr },
+    { "solve_12_3_10",  false, 12, 3, 10, false, nullptr },
+    { "solve_13_2_8",   false, 13, 2,  8, true,  nullptr },
+    { "solve_13_3_10",  false, 13, 3, 10, false, nullptr },
+    { "solve_14_4_12",  false, 14, 4, 12, false, nullptr },
+    { "solve_16_2_8",   false, 16, 2,  8, false, nullptr },
+    { "solve_13_3_11",  true,  13, 3, 11, true,  nullptr },
+    { "solve_14_3_12",  true,  14, 3, 12, true,  nullptr },
+    { "verify_T_17_3",  false, 0, 0, 0, true, "T_17_3" },
+    { "verify_T_21_3",  false, 0, 0, 0, true, "T_21_3" },
+    { "verify_T_26_3",  false, 0, 0, 0, true, "T_26_3" },
+    { "verify_T_111_3", false, 0, 0, 0, true, "T_111_3" },
+    { "verify_T_100_5_noedne", false, 0, 0, 0, true, "T_100_5_noedne" },
+    { "verify_T_100_5_elaqqad", false, 0, 0, 0, true, "T_100_5_elaqqad" },
+    { "verify_T_100_5_elaqqad_for_dummies", false, 0, 0, 0, true, "T_100_5_elaqqad_for_dummies" },
+    { "verify_T_273_5", false, 0, 0, 0, true, "T_273_5" },
+    { "wolfy_verify_all", false, 0, 0, 0, true, nullptr },
+};
+
+struct Measurement {
+    std::string result;
+    double wall_seconds = 0;
+    unsigned long long nodes = 0;
+    long maxrss_kb = 0;
+};
+
+// What a solver child sends back to us.
+struct SolveReport {
+    bool success;
+    unsigned long long nodes;
+};
+
+static std::string read_all(int fd)
+{
+    std::string s;
+    char buf[4096];
+    ssize_t r;
+    while ((r = read(fd, buf, sizeof buf)) > 0) {
+        s.append(buf, r);
+    }
+    return s;
+}
+
+// Fork; the child runs child_main with the write end of a pipe as its stdout,
+// and we collect everything it writes there, its exit status and its rusage.
+template<class F>
+static Measurement run_in_child(F child_main, std::string& output, int& status)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+        child_main();
+        _exit(EXIT_FAILURE);
+    }
+    close(fds[1]);
+    output = read_all(fds[0]);
+    close(fds[0]);
+    struct rusage usage;
+    while (wait4(pid, &status, 0, &usage) < 0) {
+        assert(errno == EINTR);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    Measurement m;
+    m.wall_seconds = elapsed.count();
+    m.maxrss_kb = usage.ru_maxrss;
+    return m;
+}
+
+static bool exited_cleanly(int status)
+{
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static Measurement run_solver_cell(const Workload& w)
+{
+    std::string output;
+    int status;
+    Measurement m = run_in_child([&]() {
+        SearchStats stats;
+        SolveOptions options;
+        options.num_threads = 1;
+        options.stats = &stats;
+        NktResult result = solve_wolves(w.n, w.k, w.t, options);
+        SolveReport report = { result.success, stats.total_nodes() };
+        fflush(stdout);
+        if (write(STDOUT_FILENO, &report, sizeof report) != sizeof report) {
+            _exit(EXIT_FAILURE);
+        }
+        _exit(0);
+    }, output, status);
+
+    SolveReport report;
+    if (!exited_cleanly(status) || output.size() < sizeof report) {
+        m.result = "CRASH";
+        return m;
+    }
+    memcpy(&report, output.data() + output.size() - sizeof report, sizeof report);
+    m.nodes = report.nodes;
+    m.result = report.success ? "YES" : "NO";
+    if (report.success != w.expected) {
+        m.result += "(WRONG)";
+    }
+    return m;
+}
+
+static Measurement run_program(std::vector<std::string> argv, const char *cwd, const char *failure_marker)
+{
+    std::string output;
+    int status;
+    Measurement m = run_in_child([&]() {
+        if (cwd != nullptr && chdir(cwd) != 0) {
+            perror(cwd);
+            _exit(EXIT_FAILURE);
+        }
+        std::vector<char*> args;
+        for (std::string& a : argv) args.push_back(&a[0]);
+        args.push_back(nullptr);
+        execv(args[0], args.data());
+        perror(args[0]);
+        _exit(EXIT_FAILURE);
+    }, output, status);
+
+    if (!exited_cleanly(status) || output.find(failure_marker) != std::string::npos) {
+        m.result = "FAIL";
+    } else {
+        m.result = "ok";
+    }
+    return m;
+}
+
+static std::string absolute_path(const char *path)
+{
+    char buf[PATH_MAX];
+    if (realpath(path, buf) == nullptr) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    return buf;
+}
+
+int main(int argc, char **argv)
+{
+    bool full = false;
+    const char *only = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--full") == 0) {
+            full = true;
+        } else if (argv[i][0] != '-' && only == nullptr) {
+            only = argv[i];
+        } else {
+            printf("Usage: ./bn [--full] [WORKLOAD]\n");
+            printf("  Run the benchmark corpus (with --full, including the solver cells that\n");
+            printf("  take many minutes), or just the named workload, and print one\n");
+            printf("  tab-separated line per workload. ./vs and ./wolfy must already be built.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    std::string vs = absolute_path("vs");
+    std::string wolfy = absolute_path("wolfy");
+    std::string wolfy_out = absolute_path("wolfy-out.txt");
+
+    // wolfy rewrites wolfy-out.txt in its working directory, so give it one of its own.
+    char scratch[] = "/tmp/wolves-bench.XXXXXX";
+    if (mkdtemp(scratch) == nullptr) {
+        perror("mkdtemp");
+        exit(EXIT_FAILURE);
+    }
+    std::string scratch_out = std::string(scratch) + "/wolfy-out.txt";
+    std::string scratch_bounds = std::string(scratch) + "/wolves-bounds.txt";
+
+    printf("workload\tresult\twall_s\tnodes\tmaxrss_kb\n");
+    fflush(stdout);
+    bool all_ok = true;
+    for (const Workload& w : corpus) {
+        if (only != nullptr ? (strcmp(only, w.name) != 0) : (w.full_only && !full)) {
+            continue;
+        }
+        Measurement m;
+        if (w.n != 0) {
+            m = run_solver_cell(w);
+        } else if (w.strategy != nullptr) {
+            m = run_program({vs, w.strategy}, nullptr, "Failure!");
+        } else {
+            m = run_program({wolfy, "--file", wolfy_out, "--bounds", scratch_bounds, "--verify-all", "1", "1"}, scratch, "INVALID!");
+        }
+        all_ok = all_ok && (m.result == "ok" || m.result == "YES" || m.result == "NO");
+        // Only the solver cells count the nodes they visit.
+        std::string nodes = (w.n != 0) ? std::to_string(m.nodes) : "-";
+        printf("%s\t%s\t%.3f\t%s\t%ld\n", w.name, m.result.c_str(), m.wall_seconds, nodes.c_str(), m.maxrss_kb);
+        fflush(stdout);
+    }
+
+    unlink(scratch_out.c_str());
+    unlink(scratch_bounds.c_str());
+    rmdir(scratch);
+    return all_ok ? 0 : 1;
+}
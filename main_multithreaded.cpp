@@ -1,31 +1,160 @@
 
+#include <algorithm>
 #include <assert.h>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <dirent.h>
+#include <errno.h>
+#include <functional>
+#include <limits.h>
+#include <math.h>
+#include <memory>
 #include <mutex>
+#include <queue>
+#include <sched.h>
+#include <signal.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <string>
+#include <sys/stat.h>
 #include <thread>
+#include <time.h>
+#include <unistd.h>
 #include <vector>
-#include "eytzinger_utils.h"
+#include "bounds_db.h"
+#include "checkpoint.h"
+#include "cluster.h"
 #include "wolves.h"
 
+namespace {
+// The log goes through a ring of messages to a thread of its own, which
+// writes them out in batches, so that no worker ever waits on stderr, nor on
+// another worker's message: each one claims a slot with a single atomic
+// increment. Only if the ring fills up does a worker have to wait for room.
+// (This is the usual bounded queue in which each slot's sequence number says
+// whether it's waiting to be filled or to be emptied.)
+struct LogRing {
+    static constexpr size_t capacity = 4096;  // a power of two
+    struct Slot {
+        std::atomic<size_t> sequence;
+        std::string text;
+    };
+    std::unique_ptr<Slot[]> slots{new Slot[capacity]};
+    std::atomic<size_t> head{0};     // the next slot to fill
+    size_t tail = 0;                 // the next slot to empty; only the writer touches it
+    std::atomic<size_t> written{0};  // every message before this one is out
+
+    LogRing() {
+        for (size_t i = 0; i < capacity; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    void push(std::string text) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[pos & (capacity - 1)];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            if (sequence == pos) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.text = std::move(text);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return;
+                }
+            } else if (sequence < pos) {
+                // Full: the writer hasn't yet emptied this slot from last time round.
+                std::this_thread::yield();
+                pos = head.load(std::memory_order_relaxed);
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void write_forever() {
+        std::string batch;
+        while (true) {
+            batch.clear();
+            while (true) {
+                Slot& slot = slots[tail & (capacity - 1)];
+                if (slot.sequence.load(std::memory_order_acquire) != tail + 1) {
+                    break;
+                }
+                batch += slot.text;
+                slot.text.clear();
+                slot.sequence.store(tail + capacity, std::memory_order_release);
+                tail += 1;
+            }
+            if (batch.empty()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                continue;
+            }
+            fwrite(batch.data(), 1, batch.size(), stderr);
+            fflush(stderr);
+            written.store(tail, std::memory_order_release);
+        }
+    }
+};
+} // anonymous namespace
+
+static void flush_log();
+
+static LogRing& log_ring()
+{
+    // Never destroyed, since the writer never stops.
+    static LogRing *ring = []() {
+        LogRing *r = new LogRing;
+        std::thread(&LogRing::write_forever, r).detach();
+        atexit(flush_log);
+        return r;
+    }();
+    return *ring;
+}
+
+// Wait until everything logged so far is out.
+static void flush_log()
+{
+    LogRing& ring = log_ring();
+    const size_t target = ring.head.load(std::memory_order_acquire);
+    while (ring.written.load(std::memory_order_acquire) < target) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
 static void log_message(const char *fmt, ...)
 {
-    static std::mutex m;
-    std::lock_guard<std::mutex> lk(m);
     va_list ap;
     va_start(ap, fmt);
-    vfprintf(stderr, fmt, ap);
+    char buffer[256];
+    int len = vsnprintf(buffer, sizeof buffer, fmt, ap);
     va_end(ap);
+    if (len < 0) {
+        return;
+    }
+    std::string text;
+    if (size_t(len) < sizeof buffer) {
+        text = buffer;
+    } else {
+        text.resize(len + 1);
+        va_start(ap, fmt);
+        vsnprintf(&text[0], text.size(), fmt, ap);
+        va_end(ap);
+        text.resize(len);
+    }
+    log_ring().push(std::move(text));
 }
 
 struct WorkItem {
-    std::atomic<bool> *stop_working = nullptr;
+    std::shared_ptr<std::atomic<bool>> stop_working = nullptr;
     int min_t = 0;
     int max_t = INT_MAX;
     int worker_t = 0;
+    int checkpoint_t = -1;  // we have a checkpoint from an unfinished search at this t
+    double checkpoint_seconds = 0;  // how long the search that left it had run
+    bool dedicated = false;  // the active task is queued for the dedicated workers
 
     void pre_solve(int t) {
         min_t = t;
@@ -55,57 +184,140 @@ struct WorkItem {
     }
 };
 
+struct Task {
+    int n, k, t;
+    double priority;  // tasks with lower priority values are started first
+    bool resume;  // pick up from the cell's checkpoint file
+    std::shared_ptr<std::atomic<bool>> stop_working;
+    bool dedicated;  // only a dedicated worker should take this task
+
+    bool operator<(const Task& rhs) const { return priority > rhs.priority; }
+};
+
+struct TaskResult {
+    // Joined and Left tell the scheduler that a remote worker came or went.
+    enum Kind { Positive, Negative, Interrupted, Joined, Left } kind;
+    int n, k, t;
+    double seconds = 0;  // how long the worker spent on the task
+};
+
+// Predicts how many seconds of a worker's time a search for (n,k,t) will take,
+// separately for searches that find a solution and searches that prove there
+// is none, as
+//     log2(seconds) = w0 + w1*n + w2*log2(C(n,k)) + w3*(t - log2(C(n,k)))
+// The weights start out at a rough fit to a few single-threaded timings, and
+// are refit by ridge regression, pulled towards those starting weights, each
+// time a search finishes; so after a few dozen cells they describe this
+// machine and these options rather than that one. A refutation near the
+// information-theoretic bound is cheap, and gets dramatically dearer with
+// every test of slack; a solution gets dearer mostly with n.
+struct CostModel {
+    static constexpr int num_features = 4;
+    static constexpr double prior_weight = 4.0;
+
+    struct Fit {
+        double xtx[num_features][num_features] = {};
+        double xty[num_features] = {};
+        double prior[num_features];
+        double w[num_features];
+    };
+    Fit fits[2];  // indexed by whether the search found a solution
+
+    CostModel() {
+        const double negative[num_features] = {-24, 1, 0, 6.5};
+        const double positive[num_features] = {-38, 3, 0, -1};
+        for (int i = 0; i < num_features; ++i) {
+            fits[0].prior[i] = fits[0].w[i] = negative[i];
+            fits[1].prior[i] = fits[1].w[i] = positive[i];
+        }
+    }
+
+    static void features(int n, int k, int t, double *x) {
+        double log_arrangements = (lgamma(n + 1.0) - lgamma(k + 1.0) - lgamma(n - k + 1.0)) / log(2.0);
+        x[0] = 1;
+        x[1] = n;
+        x[2] = log_arrangements;
+        x[3] = t - log_arrangements;
+    }
+
+    double seconds(int n, int k, int t, bool positive) const {
+        double x[num_features];
+        features(n, k, t, x);
+        double log_seconds = 0;
+        for (int i = 0; i < num_features; ++i) {
+            log_seconds += fits[positive].w[i] * x[i];
+        }
+        return exp2(std::min(std::max(log_seconds, -20.0), 40.0));
+    }
+
+    void observe(int n, int k, int t, bool positive, double seconds) {
+        Fit& f = fits[positive];
+        double x[num_features];
+        features(n, k, t, x);
+        double y = log2(std::max(seconds, 1e-3));
+        for (int i = 0; i < num_features; ++i) {
+            for (int j = 0; j < num_features; ++j) {
+                f.xtx[i][j] += x[i] * x[j];
+            }
+            f.xty[i] += x[i] * y;
+        }
+        // Solve (X'X + lambda I) w = X'y + lambda prior by Gaussian elimination.
+        double a[num_features][num_features + 1];
+        for (int i = 0; i < num_features; ++i) {
+            for (int j = 0; j < num_features; ++j) {
+                a[i][j] = f.xtx[i][j] + (i == j ? prior_weight : 0);
+            }
+            a[i][num_features] = f.xty[i] + prior_weight * f.prior[i];
+        }
+        for (int c = 0; c < num_features; ++c) {
+            int pivot = c;
+            for (int r = c + 1; r < num_features; ++r) {
+                if (fabs(a[r][c]) > fabs(a[pivot][c])) pivot = r;
+            }
+            std::swap(a[c], a[pivot]);
+            for (int r = 0; r < num_features; ++r) {
+                if (r != c) {
+                    double m = a[r][c] / a[c][c];
+                    for (int j = c; j <= num_features; ++j) {
+                        a[r][j] -= m * a[c][j];
+                    }
+                }
+            }
+        }
+        for (int i = 0; i < num_features; ++i) {
+            f.w[i] = a[i][num_features] / a[i][i];
+        }
+    }
+};
+
+// The triangle itself is touched only by the scheduler thread, which assigns
+// tasks and propagates bounds. Workers never take its lock; the scheduler hands
+// them tasks through a TaskQueue, and they hand back results through a Mailbox.
 struct Triangle {
-    std::mutex mtx;
-    std::condition_variable cv;
     std::vector<std::vector<WorkItem>> entries;
+    BoundsDB& db;
+    CostModel costs;
+    double long_shot_seconds = 3600;
+    bool have_dedicated_workers = false;
 
-    explicit Triangle(int n) {
-        static constexpr int X = -1;
-        std::vector<std::vector<int>> known_entries = {
-            {0},
-            {0, 0},
-            {0, 1, 0},
-            {0, 2, 2, 0},
-            {0, 2, 3, 3, 0},
-            {0, 3, 4, 4, 4, 0},
-            {0, 3, 5, 5, 5, 5, 0},
-            {0, 3, 6, 6, 6, 6, 6, 0},
-            {0, 3, 6, 7, 7, 7, 7, 7, 0},
-            {0, 4, 7, 8, 8, 8, 8, 8, 8, 0},
-            {0, 4, 7, 9, 9, 9, 9, 9, 9, 9, 0},
-            {0, 4, 8,10,10,10,10,10,10,10,10, 0},
-            {0, 4, 8,11,11,11,11,11,11,11,11,11, 0},
-            {0, 4, 8,12,12,12,12,12,12,12,12,12,12, 0},
-            {0, 4, 9, X,13,13,13,13,13,13,13,13,13,13, 0},
-            {0, 4, 9, X,14,14,14,14,14,14,14,14,14,14,14, 0},
-            {0, 4, X, X, X,15,15,15,15,15,15,15,15,15,15,15, 0},
-            {0, 5, X, X, X,16,16,16,16,16,16,16,16,16,16,16,16, 0},
-            {0, 5, X, X, X, X,17,17,17,17,17,17,17,17,17,17,17,17, 0},
-            {0, 5, X, X, X, X,18,18,18,18,18,18,18,18,18,18,18,18,18, 0},
-            {0, 5, X, X, X, X, X,19,19,19,19,19,19,19,19,19,19,19,19,19, 0},
-        };
-        for (int n = 0; n < known_entries.size(); ++n) {
-            assert(known_entries[n].size() == n + 1);
-            entries.emplace_back();
-            for (int k = 0; k <= n; ++k) {
-                int t = known_entries[n][k];
-                entries.back().emplace_back();
-                if (t >= 0) {
-                    entries.back().back().pre_solve(t);
-                }
+    explicit Triangle(BoundsDB& db) : db(db) {
+        // Pick up everything we know, whether built in or proved in earlier runs.
+        while (entries.size() < db.rows()) {
+            start_fresh_row();
+        }
+        for (int n = 0; n < entries.size(); ++n) {
+            for (int k = 1; k < n; ++k) {
+                WorkItem& e = entries[n][k];
+                e.min_t = std::max(e.min_t, db.lower_bound(n, k));
+                e.max_t = std::min(e.max_t, db.upper_bound(n, k));
+                assert(e.min_t <= e.max_t);
             }
         }
-        // Now fill in all the correct mins and maxes.
         for (int n = 0; n < entries.size(); ++n) {
-            assert(entries[n].size() == n + 1);
             for (int k = 0; k <= n; ++k) {
                 update_mins_and_maxes(n, k);
             }
         }
-        if (entries.size() > n) {
-            entries.resize(n);
-        }
     }
 
     void update_mins_and_maxes(int n, int k) {
@@ -181,145 +393,1067 @@ struct Triangle {
         }
     }
 
-    std::tuple<int, int, int> get_work(std::atomic<bool> *stop_working) {
-        auto assign = [&](int n, int k) {
-            assert(entries[n][k].stop_working == nullptr);
-            entries[n][k].stop_working = stop_working;
-            entries[n][k].worker_t = (entries[n][k].min_t + entries[n][k].max_t) / 2;
-            log_message("Working on n=%d, k=%d, t=%d (min=%d max=%d)\n", n, k, entries[n][k].worker_t, entries[n][k].min_t, entries[n][k].max_t);
-            return std::make_tuple(n, k, entries[n][k].worker_t);
+    // Which t to try next in cell (n,k), and what trying it is worth. With no
+    // better idea, every answer in [min_t, max_t] is taken to be equally
+    // likely, so that trying t tells us about log2(max_t - min_t + 1) bits
+    // less what the answers still left after it leave us not knowing. The
+    // best t is the one that's the cheapest per bit; an unfinished search
+    // is always picked up where it left off, and is expected to need at least
+    // as long again as it has run so far.
+    struct Choice {
+        int t;
+        double seconds;
+        double bits;
+    };
+
+    Choice best_choice(int n, int k) const {
+        const WorkItem& e = entries[n][k];
+        assert(e.min_t < e.max_t);
+        const int answers = e.max_t - e.min_t + 1;
+        auto choice_at = [&](int t) {
+            double p = double(t - e.min_t + 1) / answers;
+            double bits = log2(answers) - p * log2(t - e.min_t + 1) - (1 - p) * log2(e.max_t - t);
+            double seconds = p * costs.seconds(n, k, t, true) + (1 - p) * costs.seconds(n, k, t, false);
+            return Choice{t, seconds, bits};
         };
-        std::unique_lock<std::mutex> lk(mtx);
-        for (int n=0; n < entries.size(); ++n) {
-            assert(entries[n].size() == n+1);
-            // Assign work from the middle of a row: k == n/2 is easier.
-            if (entries[n][1].is_unstarted()) {
-                return assign(n, 1);
-            }
-            int workers_already_in_this_row = 0;
-            for (int k=0; k < n; ++k) {
-                if (entries[n][k].is_in_progress()) {
-                    workers_already_in_this_row += 1;
-                }
+        if (e.min_t <= e.checkpoint_t && e.checkpoint_t < e.max_t) {
+            Choice c = choice_at(e.checkpoint_t);
+            c.seconds = std::max(c.seconds - e.checkpoint_seconds, e.checkpoint_seconds);
+            return c;
+        }
+        Choice best = choice_at(e.min_t);
+        for (int t = e.min_t + 1; t < e.max_t; ++t) {
+            Choice c = choice_at(t);
+            if (c.seconds * best.bits < best.seconds * c.bits) {
+                best = c;
             }
-            if (workers_already_in_this_row <= 1) {
-                // Avoid putting too many workers in a single row
-                // of the triangle, because they'll be constantly
-                // interrupting each other.
-                for (int i=0; i < n; ++i) {
-                    int k = eytzinger_from_rank(i, n);
-                    assert(0 <= k && k < n);
-                    if (entries[n][k].is_unstarted()) {
-                        return assign(n, k);
+        }
+        return best;
+    }
+
+    // Hand out the cheapest information going: whichever cell's best choice
+    // costs the least per bit. Each worker already in a row makes its other
+    // cells look that much dearer, since the workers in a row tend to keep
+    // interrupting each other. A long shot, expected to run for longer than
+    // long_shot_seconds, goes to a dedicated worker if there are any, and a
+    // dedicated worker takes long shots for as long as there are any. A new
+    // row is started only once every cell is solved or being worked on; were
+    // there always a fresh one waiting, its cheap k == 1 cell would always win,
+    // and each would start another.
+    Task get_work(bool dedicated) {
+        while (true) {
+            int best_n = -1, best_k = -1;
+            Choice best = {0, 0, 0};
+            double best_priority = 0;
+            bool best_wanted = false;
+            for (int n = 0; n < entries.size(); ++n) {
+                assert(entries[n].size() == n+1);
+                int workers_already_in_this_row = 0;
+                for (int k = 0; k < n; ++k) {
+                    if (entries[n][k].is_in_progress()) {
+                        workers_already_in_this_row += 1;
+                    }
+                }
+                for (int k = 1; k < n; ++k) {
+                    if (!entries[n][k].is_unstarted()) {
+                        continue;
+                    }
+                    Choice c = best_choice(n, k);
+                    double priority = c.seconds * (1 + workers_already_in_this_row) / c.bits;
+                    // Prefer the kind of task this worker is for; within a kind, the cheapest per bit.
+                    bool wanted = !have_dedicated_workers || (c.seconds > long_shot_seconds) == dedicated;
+                    if (best_n < 0 || (wanted && !best_wanted) || (wanted == best_wanted && priority < best_priority)) {
+                        best_n = n;
+                        best_k = k;
+                        best = c;
+                        best_priority = priority;
+                        best_wanted = wanted;
                     }
                 }
             }
+            if (best_n >= 0) {
+                WorkItem& e = entries[best_n][best_k];
+                auto stop_working = std::make_shared<std::atomic<bool>>(false);
+                e.stop_working = stop_working;
+                e.worker_t = best.t;
+                e.dedicated = dedicated;
+                bool resume = (e.worker_t == e.checkpoint_t);
+                log_message("%s n=%d, k=%d, t=%d (min=%d max=%d), expecting %.3g bits in %.3g seconds\n",
+                            resume ? "Resuming" : "Working on", best_n, best_k, e.worker_t, e.min_t, e.max_t,
+                            best.bits, best.seconds);
+                return Task{best_n, best_k, e.worker_t, best_priority, resume, stop_working, dedicated};
+            }
+            // Everything is either solved or being worked on. Start a fresh row.
+            start_fresh_row();
         }
-        // We didn't find any work not-yet-being-done. Start a fresh row.
-        start_fresh_row();
-        lk.unlock();
-        return get_work(stop_working);
     }
 
-    void report_early_terminate(int n, int k) {
-        std::lock_guard<std::mutex> lk(mtx);
+    void report_early_terminate(int n, int k, int t, double seconds) {
         assert(0 <= n && n < entries.size());
         assert(0 <= k && k <= entries[n].size());
-        entries[n][k].stop_working = nullptr;
+        WorkItem& e = entries[n][k];
+        e.stop_working = nullptr;
+        e.checkpoint_seconds = (e.checkpoint_t == t ? e.checkpoint_seconds : 0) + seconds;
+        e.checkpoint_t = t;
     }
 
-    void report_positive_result(int n, int k, int t) {
-        std::lock_guard<std::mutex> lk(mtx);
+    // The whole search took this long, counting any runs it was resumed from.
+    double total_seconds(int n, int k, int t, double seconds) const {
+        const WorkItem& e = entries[n][k];
+        return seconds + (e.checkpoint_t == t ? e.checkpoint_seconds : 0);
+    }
+
+    bool report_positive_result(int n, int k, int t, double seconds) {
         assert(0 <= n && n < entries.size());
         assert(0 <= k && k <= entries[n].size());
         assert(entries[n][k].min_t <= t);
         // It can be done in "t" steps, so the new maximum is "t".
+        costs.observe(n, k, t, true, total_seconds(n, k, t, seconds));
         entries[n][k].stop_working = nullptr;
+        entries[n][k].checkpoint_t = -1;
+        entries[n][k].checkpoint_seconds = 0;
+        db.report_positive_result(n, k, t);
         if (t < entries[n][k].max_t) {
             entries[n][k].max_t = t;
             update_mins_and_maxes(n, k);
-            cv.notify_all();
+            return true;
         }
+        return false;
     }
 
-    void report_negative_result(int n, int k, int t) {
-        std::lock_guard<std::mutex> lk(mtx);
+    bool report_negative_result(int n, int k, int t, double seconds) {
         assert(0 <= n && n < entries.size());
         assert(0 <= k && k <= entries[n].size());
         assert(t <= entries[n][k].max_t);
         // It can't be done in "t" steps, so the new minimum is "t+1".
+        costs.observe(n, k, t, false, total_seconds(n, k, t, seconds));
         entries[n][k].stop_working = nullptr;
+        entries[n][k].checkpoint_t = -1;
+        entries[n][k].checkpoint_seconds = 0;
+        db.report_negative_result(n, k, t);
         if (entries[n][k].min_t < t+1) {
             entries[n][k].min_t = t+1;
             update_mins_and_maxes(n, k);
-            cv.notify_all();
+            return true;
+        }
+        return false;
+    }
+
+    // What the printer needs to know about each cell.
+    struct CellSnapshot {
+        int min_t, max_t;
+        bool in_progress;
+
+        // Its answer if known, else -1 if someone is working on it, else -2.
+        int display_value() const { return (min_t == max_t) ? min_t : in_progress ? -1 : -2; }
+    };
+    using Snapshot = std::vector<std::vector<CellSnapshot>>;
+
+    std::shared_ptr<const Snapshot> snapshot() const {
+        auto result = std::make_shared<Snapshot>();
+        for (auto&& row : entries) {
+            result->emplace_back();
+            for (auto&& e : row) {
+                result->back().push_back(CellSnapshot{e.min_t, e.max_t, e.is_in_progress()});
+            }
+        }
+        return result;
+    }
+};
+
+// The dedicated workers have a queue of their own.
+struct TaskQueue {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::priority_queue<Task> tasks[2];  // indexed by Task::dedicated
+    bool closed = false;
+
+    void push(Task task) {
+        std::lock_guard<std::mutex> lk(mtx);
+        tasks[task.dedicated].push(std::move(task));
+        cv.notify_all();
+    }
+
+    // Returns false once the queue has been closed.
+    bool pop(Task *task, bool dedicated = false) {
+        std::unique_lock<std::mutex> lk(mtx);
+        cv.wait(lk, [&]() { return closed || !tasks[dedicated].empty(); });
+        if (closed) {
+            return false;
+        }
+        *task = tasks[dedicated].top();
+        tasks[dedicated].pop();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lk(mtx);
+        closed = true;
+        cv.notify_all();
+    }
+};
+
+struct Mailbox {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<TaskResult> results;
+
+    void post(TaskResult result) {
+        std::lock_guard<std::mutex> lk(mtx);
+        results.push_back(result);
+        cv.notify_one();
+    }
+
+    std::vector<TaskResult> wait_and_take_all() {
+        std::unique_lock<std::mutex> lk(mtx);
+        cv.wait(lk, [&]() { return !results.empty(); });
+        return std::move(results);
+    }
+};
+
+// The scheduler publishes a fresh snapshot of the triangle whenever it changes;
+// the printer prints from the snapshot without ever touching the triangle.
+struct SnapshotBoard {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::shared_ptr<const Triangle::Snapshot> snapshot;
+    int version = 0;
+
+    void publish(std::shared_ptr<const Triangle::Snapshot> s) {
+        std::lock_guard<std::mutex> lk(mtx);
+        snapshot = std::move(s);
+        version += 1;
+        cv.notify_all();
+    }
+
+    // Returns nullptr if nothing new is published by the deadline.
+    std::shared_ptr<const Triangle::Snapshot> wait_for_newer_than(int& seen, std::chrono::steady_clock::time_point deadline) {
+        std::unique_lock<std::mutex> lk(mtx);
+        if (!cv.wait_until(lk, deadline, [&]() { return version != seen; })) {
+            return nullptr;
         }
+        seen = version;
+        return snapshot;
     }
 };
 
-static void worker_thread(Triangle& triangle)
+// Set by SIGINT or SIGTERM: every worker checkpoints its search and quits.
+static std::atomic<bool> shutting_down(false);
+
+static void request_shutdown(int)
 {
-    std::atomic<bool> stop_working(false);
-    std::tuple<int, int, int> nkt = triangle.get_work(&stop_working);
-    auto early_terminate = [&]() {
-        return stop_working.load();
-    };
-    int n = std::get<0>(nkt);
-    int k = std::get<1>(nkt);
-    int t = std::get<2>(nkt);
+    shutting_down = true;
+}
+
+static void scheduler_thread(Triangle& triangle, TaskQueue& queue, Mailbox& mailbox, SnapshotBoard& board,
+                             int num_workers, int num_dedicated_workers)
+{
+    // Keep one task queued beyond what the workers are running, so that a worker
+    // who finishes never has to wait for us to propagate its result; likewise
+    // for the dedicated workers, if there are any.
+    int workers[2] = {num_workers - num_dedicated_workers, num_dedicated_workers};
+    int tasks_in_flight[2] = {0, 0};
+    triangle.have_dedicated_workers = (num_dedicated_workers != 0);
+    bool changed = true;
+    while (true) {
+        for (int dedicated = 0; dedicated < (num_dedicated_workers ? 2 : 1); ++dedicated) {
+            while (tasks_in_flight[dedicated] < workers[dedicated] + 1 && !shutting_down) {
+                queue.push(triangle.get_work(dedicated));
+                tasks_in_flight[dedicated] += 1;
+                changed = true;
+            }
+        }
+        if (changed) {
+            board.publish(triangle.snapshot());
+            changed = false;
+        }
+        for (const TaskResult& r : mailbox.wait_and_take_all()) {
+            bool dedicated = (r.kind == TaskResult::Joined || r.kind == TaskResult::Left) ? false : triangle.entries[r.n][r.k].dedicated;
+            switch (r.kind) {
+                case TaskResult::Positive: changed |= triangle.report_positive_result(r.n, r.k, r.t, r.seconds); break;
+                case TaskResult::Negative: changed |= triangle.report_negative_result(r.n, r.k, r.t, r.seconds); break;
+                case TaskResult::Interrupted: triangle.report_early_terminate(r.n, r.k, r.t, r.seconds); break;
+                case TaskResult::Joined: workers[0] += 1; continue;
+                case TaskResult::Left: workers[0] -= 1; continue;
+            }
+            tasks_in_flight[dedicated] -= 1;
+        }
+    }
+}
+
+static std::string checkpoint_filename(const std::string& dir, int n, int k)
+{
+    return dir + "/n" + std::to_string(n) + "-k" + std::to_string(k) + ".txt";
+}
+
+struct WorkerConfig {
+    int solver_threads;
+    std::string checkpoint_dir;
+    double checkpoint_interval;
+    int isomorph_depth;
+    // Besides the checkpointed numeric search, race a search in each of these orders.
+    std::vector<MaskOrder> portfolio;
+    unsigned long long restart_nodes;
+};
+
+// Search one cell, resuming from *resume_from if it's given and fits, and
+// passing every checkpoint along to on_checkpoint. If the answer is positive,
+// *message receives the solution.
+static TaskResult solve_cell(int n, int k, int t, const WorkerConfig& config, std::function<bool()> early_terminate,
+                             const SolveCheckpoint *resume_from, std::function<void(const SolveCheckpoint&)> on_checkpoint,
+                             std::string *message)
+{
+    // Split this cell's search tree across this worker's cores, too, so that a
+    // single hard cell can soak up the cores the other workers aren't using.
+    SolveOptions options;
+    options.num_threads = config.solver_threads;
+    options.early_terminate = std::move(early_terminate);
+    options.on_checkpoint = std::move(on_checkpoint);
+    options.checkpoint_interval = config.checkpoint_interval;
+    options.isomorph_rejection_depth = config.isomorph_depth;
+    if (resume_from != nullptr && resume_from->n == n && resume_from->k == k && resume_from->t == t
+        && resume_from->test_population == 0 && resume_from->isomorph_rejection_depth == config.isomorph_depth) {
+        options.resume_from = resume_from;
+    }
+    // The other members of the portfolio share this worker's cores, and are
+    // simply started afresh (with seeds of their own) if the cell comes back.
+    std::vector<SolveOptions> members = {options};
+    for (size_t i = 0; i < config.portfolio.size(); ++i) {
+        SolveOptions member;
+        member.early_terminate = options.early_terminate;
+        member.isomorph_rejection_depth = options.isomorph_rejection_depth;
+        member.mask_order = config.portfolio[i];
+        member.seed = i + 1;
+        member.restart_nodes = config.restart_nodes;
+        members.push_back(std::move(member));
+    }
+    for (auto&& member : members) {
+        member.num_threads = std::max(1, config.solver_threads / int(members.size()));
+    }
+#ifdef WOLVES_STATS
+    SearchStats stats;
+    for (auto&& member : members) {
+        member.stats = &stats;
+    }
+    auto start = std::chrono::steady_clock::now();
+    struct ReportStats {
+        const SearchStats& stats;
+        std::chrono::steady_clock::time_point start;
+        int n, k, t;
+        ~ReportStats() {
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            if (stats.total_nodes() != 0) {
+                log_message("Searched n=%d, k=%d, t=%d: %s", n, k, t, format_search_stats(stats, elapsed.count()).c_str());
+            }
+        }
+    } report_stats{stats, start, n, k, t};
+#endif
     try {
-        NktResult result = solve_wolves(n, k, t, early_terminate);
+        NktResult result = solve_wolves_portfolio(n, k, t, members);
         if (result.success) {
-            log_message("%s", result.message.c_str());
-            return triangle.report_positive_result(n, k, t);
+            *message = result.message;
+            return TaskResult{TaskResult::Positive, n, k, t};
         } else {
-            return triangle.report_negative_result(n, k, t);
+            return TaskResult{TaskResult::Negative, n, k, t};
         }
     } catch (const EarlyTerminateException&) {
-        // We have been instructed to give up early.
-        return triangle.report_early_terminate(n, k);
+        // We have been instructed to give up early. Our checkpoint has been saved.
+        return TaskResult{TaskResult::Interrupted, n, k, t};
+    }
+}
+
+static void worker_thread(const Task& task, Mailbox& mailbox, const WorkerConfig& config)
+{
+    auto early_terminate = [&]() {
+        return task.stop_working->load() || shutting_down.load();
+    };
+    std::string filename = checkpoint_filename(config.checkpoint_dir, task.n, task.k);
+    SolveCheckpoint checkpoint;
+    bool resume = task.resume && load_checkpoint(filename, &checkpoint);
+    std::string message;
+    auto start = std::chrono::steady_clock::now();
+    TaskResult result = solve_cell(task.n, task.k, task.t, config, early_terminate, resume ? &checkpoint : nullptr,
+        [&](const SolveCheckpoint& c) { save_checkpoint(filename, c); },
+        &message
+    );
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    result.seconds = elapsed.count();
+    if (result.kind != TaskResult::Interrupted) {
+        unlink(filename.c_str());
+    }
+    if (!message.empty()) {
+        log_message("%s", message.c_str());
+    }
+    mailbox.post(result);
+}
+
+// Read the rest of a CHECKPOINT message from the other end of the connection.
+static bool read_checkpoint(Connection& conn, SolveCheckpoint *checkpoint)
+{
+    std::string text;
+    std::string line;
+    do {
+        if (conn.read_line(&line, lease_timeout_ms) != Connection::Line) {
+            return false;
+        }
+        text += line + "\n";
+    } while (line != "end");
+    return parse_checkpoint(text, checkpoint);
+}
+
+// Hand a task to a remote worker, and relay its checkpoints and result back to
+// the scheduler. Returns false if we've lost the worker.
+static bool lease_task(Connection& conn, const Task& task, Mailbox& mailbox, const std::string& checkpoint_dir)
+{
+    const int n = task.n;
+    const int k = task.k;
+    const int t = task.t;
+    std::string filename = checkpoint_filename(checkpoint_dir, n, k);
+    std::string tnk = std::to_string(n) + " " + std::to_string(k) + " " + std::to_string(t);
+    SolveCheckpoint checkpoint;
+    std::string request;
+    if (task.resume && load_checkpoint(filename, &checkpoint)) {
+        request += "CHECKPOINT\n" + format_checkpoint(checkpoint);
+    }
+    request += "TASK " + tnk + "\n";
+    auto start = std::chrono::steady_clock::now();
+    auto result = [&](TaskResult::Kind kind) {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return TaskResult{kind, n, k, t, elapsed.count()};
+    };
+    if (!conn.send(request)) {
+        mailbox.post(result(TaskResult::Interrupted));
+        return false;
+    }
+
+    auto last_heard = std::chrono::steady_clock::now();
+    bool stop_sent = false;
+    std::string message;
+    while (true) {
+        if (!stop_sent && (task.stop_working->load() || shutting_down)) {
+            stop_sent = conn.send("STOP\n");
+        }
+        std::string line;
+        Connection::ReadStatus status = conn.read_line(&line, 1000);
+        if (status == Connection::Timeout && std::chrono::steady_clock::now() - last_heard < std::chrono::milliseconds(lease_timeout_ms)) {
+            continue;
+        } else if (status != Connection::Line) {
+            log_message("Lost worker %s; its lease on n=%d, k=%d, t=%d is void\n", conn.peer().c_str(), n, k, t);
+            mailbox.post(result(TaskResult::Interrupted));
+            return false;
+        }
+        last_heard = std::chrono::steady_clock::now();
+        if (line == "HEARTBEAT") {
+            // the lease is renewed
+        } else if (line == "CHECKPOINT") {
+            if (read_checkpoint(conn, &checkpoint) && checkpoint.n == n && checkpoint.k == k && checkpoint.t == t) {
+                save_checkpoint(filename, checkpoint);
+            }
+        } else if (line.compare(0, 8, "MESSAGE ") == 0) {
+            message += line.substr(8) + "\n";
+        } else if (line == "POSITIVE " + tnk) {
+            log_message("%s", message.c_str());
+            unlink(filename.c_str());
+            mailbox.post(result(TaskResult::Positive));
+            return true;
+        } else if (line == "NEGATIVE " + tnk) {
+            unlink(filename.c_str());
+            mailbox.post(result(TaskResult::Negative));
+            return true;
+        } else if (line == "INTERRUPTED " + tnk) {
+            mailbox.post(result(TaskResult::Interrupted));
+            return true;
+        } else {
+            log_message("%s: unexpected message '%s'\n", conn.peer().c_str(), line.c_str());
+        }
+    }
+}
+
+// The coordinator's stand-in for one remote worker: it pulls tasks from the
+// queue just like a local worker, but ships each one over the connection.
+static void remote_worker_thread(std::unique_ptr<Connection> conn, TaskQueue& queue, Mailbox& mailbox, std::string checkpoint_dir)
+{
+    std::string line;
+    int threads = 0;
+    if (conn->read_line(&line, lease_timeout_ms) != Connection::Line || sscanf(line.c_str(), "HELLO %d", &threads) != 1) {
+        log_message("%s: not a worker\n", conn->peer().c_str());
+        return;
+    }
+    log_message("Worker %s joined, with %d threads\n", conn->peer().c_str(), threads);
+    mailbox.post(TaskResult{TaskResult::Joined, 0, 0, 0});
+    Task task;
+    while (!shutting_down && queue.pop(&task)) {
+        if (!lease_task(*conn, task, mailbox, checkpoint_dir)) {
+            break;
+        }
+    }
+    mailbox.post(TaskResult{TaskResult::Left, 0, 0, 0});
+    log_message("Worker %s left\n", conn->peer().c_str());
+}
+
+// The other end: take tasks from the coordinator until it goes away or we're told to shut down.
+static void serve_coordinator(Connection& conn, const WorkerConfig& config)
+{
+    if (!conn.send("HELLO " + std::to_string(config.solver_threads) + "\n")) {
+        return;
+    }
+    std::atomic<bool> disconnected(false);
+    std::thread heartbeat([&]() {
+        auto next = std::chrono::steady_clock::now();
+        while (!disconnected) {
+            if (std::chrono::steady_clock::now() >= next) {
+                conn.send("HEARTBEAT\n");
+                next += std::chrono::milliseconds(heartbeat_interval_ms);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    });
+
+    std::atomic<bool> stop_working(false);
+    std::atomic<bool> busy(false);
+    std::thread solver;
+    SolveCheckpoint checkpoint;
+    bool have_checkpoint = false;
+    std::string line;
+    while (!(shutting_down && !busy)) {
+        if (shutting_down) {
+            stop_working = true;
+        }
+        Connection::ReadStatus status = conn.read_line(&line, 1000);
+        int n, k, t;
+        if (status == Connection::Closed) {
+            log_message("Lost the coordinator\n");
+            break;
+        } else if (status == Connection::Timeout) {
+            continue;
+        } else if (line == "CHECKPOINT") {
+            have_checkpoint = read_checkpoint(conn, &checkpoint);
+        } else if (sscanf(line.c_str(), "TASK %d %d %d", &n, &k, &t) == 3 && !busy) {
+            if (solver.joinable()) {
+                solver.join();
+            }
+            log_message("%s n=%d, k=%d, t=%d\n", have_checkpoint ? "Resuming" : "Working on", n, k, t);
+            stop_working = false;
+            busy = true;
+            SolveCheckpoint resume_from = have_checkpoint ? std::move(checkpoint) : SolveCheckpoint();
+            bool resume = have_checkpoint;
+            have_checkpoint = false;
+            solver = std::thread([&conn, &config, &stop_working, &busy, n, k, t, resume, resume_from]() {
+                std::string message;
+                TaskResult result = solve_cell(n, k, t, config,
+                    [&]() { return stop_working.load() || shutting_down.load(); },
+                    resume ? &resume_from : nullptr,
+                    [&](const SolveCheckpoint& c) { conn.send("CHECKPOINT\n" + format_checkpoint(c)); },
+                    &message
+                );
+                std::string reply;
+                size_t pos = 0;
+                for (size_t nl; (nl = message.find('\n', pos)) != std::string::npos; pos = nl + 1) {
+                    reply += "MESSAGE " + message.substr(pos, nl - pos) + "\n";
+                }
+                const char *kind = (result.kind == TaskResult::Positive) ? "POSITIVE" :
+                                   (result.kind == TaskResult::Negative) ? "NEGATIVE" : "INTERRUPTED";
+                reply += std::string(kind) + " " + std::to_string(n) + " " + std::to_string(k) + " " + std::to_string(t) + "\n";
+                log_message("Finished n=%d, k=%d, t=%d: %s\n", n, k, t, kind);
+                // The coordinator may send our next TASK as soon as it sees this reply.
+                busy = false;
+                conn.send(reply);
+            });
+        } else if (line == "STOP") {
+            stop_working = true;
+        } else {
+            log_message("%s: unexpected message '%s'\n", conn.peer().c_str(), line.c_str());
+        }
+    }
+    stop_working = true;
+    if (solver.joinable()) {
+        solver.join();
+    }
+    disconnected = true;
+    heartbeat.join();
+}
+
+// Note each checkpoint left behind by an earlier run, and throw away those we no longer need.
+static void load_checkpoints(Triangle& triangle, const std::string& dir)
+{
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr) {
+        return;
+    }
+    while (struct dirent *de = readdir(d)) {
+        int n, k;
+        char tail;
+        SolveCheckpoint checkpoint;
+        if (sscanf(de->d_name, "n%d-k%d.tx%c", &n, &k, &tail) != 3 || tail != 't') {
+            continue;
+        }
+        std::string filename = checkpoint_filename(dir, n, k);
+        if (!load_checkpoint(filename, &checkpoint) || checkpoint.n != n || checkpoint.k != k || !(0 < k && k < n)) {
+            continue;
+        }
+        while (triangle.entries.size() <= n) {
+            triangle.start_fresh_row();
+        }
+        WorkItem& e = triangle.entries[n][k];
+        if (e.min_t <= checkpoint.t && checkpoint.t < e.max_t) {
+            e.checkpoint_t = checkpoint.t;
+        } else {
+            unlink(filename.c_str());
+        }
+    }
+    closedir(d);
+}
+
+// Write the triangle for monitoring to scrape, in the Prometheus text format
+// (as node_exporter's textfile collector reads it), replacing the file whole.
+static void write_status_file(const std::string& filename, const Triangle::Snapshot& snapshot, int updates)
+{
+    std::string text;
+    int solved = 0, in_progress = 0, open = 0;
+    for (int n = 0; n < snapshot.size(); ++n) {
+        for (int k = 1; k < n; ++k) {
+            const Triangle::CellSnapshot& c = snapshot[n][k];
+            solved += (c.min_t == c.max_t);
+            in_progress += c.in_progress;
+            open += (c.min_t != c.max_t && !c.in_progress);
+        }
+    }
+    char buffer[200];
+    auto add = [&](const char *fmt, auto... args) {
+        snprintf(buffer, sizeof buffer, fmt, args...);
+        text += buffer;
+    };
+    add("# HELP wolves_cells How many cells t(n,k) with 0 < k < n are in each state.\n");
+    add("# TYPE wolves_cells gauge\n");
+    add("wolves_cells{state=\"solved\"} %d\n", solved);
+    add("wolves_cells{state=\"in_progress\"} %d\n", in_progress);
+    add("wolves_cells{state=\"open\"} %d\n", open);
+    add("# HELP wolves_min_t The best lower bound on t(n,k) so far.\n");
+    add("# TYPE wolves_min_t gauge\n");
+    for (int n = 0; n < snapshot.size(); ++n) {
+        for (int k = 1; k < n; ++k) {
+            add("wolves_min_t{n=\"%d\",k=\"%d\"} %d\n", n, k, snapshot[n][k].min_t);
+        }
+    }
+    add("# HELP wolves_max_t The best upper bound on t(n,k) so far.\n");
+    add("# TYPE wolves_max_t gauge\n");
+    for (int n = 0; n < snapshot.size(); ++n) {
+        for (int k = 1; k < n; ++k) {
+            add("wolves_max_t{n=\"%d\",k=\"%d\"} %d\n", n, k, snapshot[n][k].max_t);
+        }
+    }
+    add("# HELP wolves_in_progress Whether a worker is searching cell (n,k).\n");
+    add("# TYPE wolves_in_progress gauge\n");
+    for (int n = 0; n < snapshot.size(); ++n) {
+        for (int k = 1; k < n; ++k) {
+            if (snapshot[n][k].in_progress) {
+                add("wolves_in_progress{n=\"%d\",k=\"%d\"} 1\n", n, k);
+            }
+        }
+    }
+    add("# HELP wolves_updates_total How many times the triangle has been redrawn.\n");
+    add("# TYPE wolves_updates_total counter\n");
+    add("wolves_updates_total %d\n", updates);
+    add("# HELP wolves_status_time_seconds When this file was written.\n");
+    add("# TYPE wolves_status_time_seconds gauge\n");
+    add("wolves_status_time_seconds %lld\n", (long long)time(nullptr));
+
+    std::string temporary = filename + ".tmp";
+    FILE *fp = fopen(temporary.c_str(), "w");
+    if (fp == nullptr) {
+        log_message("%s: %s\n", temporary.c_str(), strerror(errno));
+        return;
+    }
+    bool ok = (fwrite(text.data(), 1, text.size(), fp) == text.size());
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(temporary.c_str(), filename.c_str()) != 0) {
+        log_message("%s: %s\n", filename.c_str(), strerror(errno));
     }
 }
 
-static void printer_thread(Triangle& triangle)
+// Redraw the triangle at most once every display_interval seconds, however
+// often it changes, from the latest snapshot; the snapshots in between are
+// simply skipped. After the first, each update shows only the rows that have
+// changed since the one before.
+static void printer_thread(SnapshotBoard& board, double display_interval, std::string status_filename)
 {
     int count = 0;
-    std::unique_lock<std::mutex> lk(triangle.mtx);
+    int seen = 0;
+    Triangle::Snapshot last_printed;
+    auto next_update = std::chrono::steady_clock::now();
+#ifdef WOLVES_STATS
+    // Every so often, also say how the search has been going since last time.
+    const auto stats_interval = std::chrono::seconds(60);
+    SearchStats last_stats;
+    auto last_tick = std::chrono::steady_clock::now();
+#endif
     while (true) {
-        printf("UPDATE %d!------------------------------\n", count);
-        for (int n = 0; n < triangle.entries.size(); ++n) {
-            printf("    n=%-2d ", n);
-            for (int k = 0; k < triangle.entries[n].size(); ++k) {
-                if (triangle.entries[n][k].has_answer()) {
-                    printf("%3d", triangle.entries[n][k].min_t);
-                } else if (triangle.entries[n][k].is_in_progress()) {
-                    printf("  x");
+#ifdef WOLVES_STATS
+        auto deadline = last_tick + stats_interval;
+#else
+        auto deadline = std::chrono::steady_clock::time_point::max();
+#endif
+        std::this_thread::sleep_until(std::min(next_update, deadline));
+        std::shared_ptr<const Triangle::Snapshot> snapshot = board.wait_for_newer_than(seen, deadline);
+#ifdef WOLVES_STATS
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            SearchStats stats = search_stats_so_far();
+            SearchStats delta = stats;
+            delta -= last_stats;
+            std::chrono::duration<double> elapsed = now - last_tick;
+            log_message("STATS: %s", format_search_stats(delta, elapsed.count()).c_str());
+            last_stats = stats;
+            last_tick = now;
+        }
+#endif
+        if (snapshot == nullptr) {
+            continue;
+        }
+        next_update = std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(display_interval));
+        std::string text = "UPDATE " + std::to_string(count) + "!------------------------------\n";
+        bool any_changed = false;
+        for (int n = 0; n < snapshot->size(); ++n) {
+            const auto& row = (*snapshot)[n];
+            bool changed = (n >= last_printed.size());
+            for (int k = 0; !changed && k <= n; ++k) {
+                changed = (row[k].display_value() != last_printed[n][k].display_value());
+            }
+            if (!changed) {
+                continue;
+            }
+            any_changed = true;
+            // Room for the widest int in either format.
+            char buffer[32];
+            snprintf(buffer, sizeof buffer, "    n=%-2d ", n);
+            text += buffer;
+            for (auto&& cell : row) {
+                int value = cell.display_value();
+                if (value >= 0) {
+                    snprintf(buffer, sizeof buffer, "%3d", value);
+                    text += buffer;
+                } else if (value == -1) {
+                    text += "  x";
                 } else {
-                    printf("  .");
+                    text += "  .";
                 }
             }
-            printf("\n");
+            text += "\n";
+        }
+        if (any_changed) {
+            fwrite(text.data(), 1, text.size(), stdout);
+            fflush(stdout);
+            last_printed = *snapshot;
+            ++count;
+        }
+        if (!status_filename.empty()) {
+            write_status_file(status_filename, *snapshot, count);
+        }
+    }
+}
+
+// Parse a sysfs CPU list such as "0-3,8-11".
+static std::vector<int> parse_cpulist(const char *s)
+{
+    std::vector<int> result;
+    while (true) {
+        char *end;
+        int lo = strtol(s, &end, 10);
+        if (end == s) break;
+        int hi = lo;
+        if (*end == '-') {
+            hi = strtol(end + 1, &end, 10);
+        }
+        for (int cpu = lo; cpu <= hi; ++cpu) {
+            result.push_back(cpu);
+        }
+        if (*end != ',') break;
+        s = end + 1;
+    }
+    return result;
+}
+
+// Return the CPUs we're allowed to run on, grouped by NUMA node.
+// Without sysfs node information, all the CPUs count as one node.
+static std::vector<std::vector<int>> get_numa_nodes()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof allowed, &allowed) != 0) {
+        return {};
+    }
+    std::vector<std::vector<int>> nodes;
+    std::vector<bool> seen(CPU_SETSIZE);
+    for (int node = 0; node < 1024; ++node) {
+        std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+        FILE *fp = fopen(path.c_str(), "r");
+        if (fp == nullptr) {
+            if (node == 0) break;
+            continue;
+        }
+        char buf[4096] = "";
+        if (fgets(buf, sizeof buf, fp) == nullptr) buf[0] = '\0';
+        fclose(fp);
+        std::vector<int> cpus;
+        for (int cpu : parse_cpulist(buf)) {
+            if (0 <= cpu && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed) && !seen[cpu]) {
+                seen[cpu] = true;
+                cpus.push_back(cpu);
+            }
         }
-        ++count;
-        triangle.cv.wait(lk);
+        if (!cpus.empty()) {
+            nodes.push_back(std::move(cpus));
+        }
+    }
+    std::vector<int> rest;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed) && !seen[cpu]) {
+            rest.push_back(cpu);
+        }
+    }
+    if (!rest.empty()) {
+        nodes.push_back(std::move(rest));
+    }
+    return nodes;
+}
+
+static void pin_current_thread(const std::vector<int>& cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    if (sched_setaffinity(0, sizeof set, &set) != 0) {
+        log_message("Failed to pin a worker to %zu CPUs; continuing unpinned\n", cpus.size());
     }
 }
 
+static constexpr const char *default_checkpoint_dir = "wolves-checkpoints";
+static constexpr double default_checkpoint_interval = 600;
+static constexpr double default_long_shot_seconds = 3600;
+static constexpr double default_display_interval = 1;
+
+static void print_usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [--bounds FILE] [--checkpoints DIR] [--checkpoint-interval SECONDS]\n", argv0);
+    fprintf(stderr, "          [--threads N] [--pin none|cores|nodes] [--isomorph-depth D]\n");
+    fprintf(stderr, "          [--portfolio ORDERS] [--restarts NODES] [--dedicated N] [--long-shot SECONDS]\n");
+    fprintf(stderr, "          [--display-interval SECONDS] [--status FILE] [--listen PORT]\n");
+    fprintf(stderr, "       %s [--threads N] [--checkpoint-interval SECONDS] [--isomorph-depth D]\n", argv0);
+    fprintf(stderr, "          [--portfolio ORDERS] [--restarts NODES] --connect HOST:PORT\n");
+    fprintf(stderr, "  Fill in the triangle of t(n,k), starting from the built-in values and the bounds file.\n");
+    fprintf(stderr, "  With --listen, remote workers started with --connect can join in over TCP;\n");
+    fprintf(stderr, "  the coordinator keeps the triangle, the bounds and all the checkpoints.\n");
+    fprintf(stderr, "  Unfinished searches are checkpointed to DIR (default %s) every SECONDS\n", default_checkpoint_dir);
+    fprintf(stderr, "  (default %g) and on SIGINT or SIGTERM, and resumed when we start again.\n", default_checkpoint_interval);
+    fprintf(stderr, "  --threads N   run N local workers (default: one per hardware thread; 0 is fine with --listen)\n");
+    fprintf(stderr, "                unpinned, each searches its cell with its share of the hardware threads\n");
+    fprintf(stderr, "  --pin cores   pin each worker to its own CPU; each cell is searched single-threaded\n");
+    fprintf(stderr, "  --pin nodes   pin workers round-robin to NUMA nodes; each cell's search stays on its node\n");
+    fprintf(stderr, "  --isomorph-depth D   skip prefixes of up to D tests that repeat one up to permutation%s\n",
+            solver_has_isomorph_rejection() ? "" : " (needs make NAUTY=1)");
+    fprintf(stderr, "  --portfolio ORDERS   race each cell's search against one in each of these comma-separated\n");
+    fprintf(stderr, "                       orders (balanced, informative, random), splitting its cores among them\n");
+    fprintf(stderr, "  --restarts NODES     restart random-order searches after NODES nodes, doubling each time\n");
+    fprintf(stderr, "  Cells are handed out cheapest-information-first, by a cost model fit to the searches so far.\n");
+    fprintf(stderr, "  --dedicated N        keep N of the local workers for long shots, and the rest off them\n");
+    fprintf(stderr, "  --long-shot SECONDS  a search expected to take longer than this is a long shot (default %g)\n",
+            default_long_shot_seconds);
+    fprintf(stderr, "  --display-interval SECONDS  redraw the triangle's changed rows at most this often (default %g)\n",
+            default_display_interval);
+    fprintf(stderr, "  --status FILE        keep FILE up to date with the triangle, for Prometheus to scrape\n");
+}
+
 int main(int argc, char **argv)
 {
-    // Precompute n rows, to pick up where we left off.
-    int n = argc == 2 ? atoi(argv[1]) : 0;
-    Triangle triangle(n);
+    const char *argv0 = argv[0];
+    const char *bounds_filename = BoundsDB::default_filename;
+    std::string checkpoint_dir = default_checkpoint_dir;
+    double checkpoint_interval = default_checkpoint_interval;
+    int num_workers = std::max(1, int(std::thread::hardware_concurrency()));
+    enum { PinNone, PinCores, PinNodes } pin = PinNone;
+    int listen_port = 0;
+    const char *coordinator = nullptr;
+    int isomorph_depth = 0;
+    std::vector<MaskOrder> portfolio;
+    bool portfolio_ok = true;
+    unsigned long long restart_nodes = 0;
+    int num_dedicated_workers = 0;
+    double long_shot_seconds = default_long_shot_seconds;
+    double display_interval = default_display_interval;
+    std::string status_filename;
+    while (argc >= 3 && strncmp(argv[1], "--", 2) == 0) {
+        if (strcmp(argv[1], "--bounds") == 0) {
+            bounds_filename = argv[2];
+        } else if (strcmp(argv[1], "--checkpoints") == 0) {
+            checkpoint_dir = argv[2];
+        } else if (strcmp(argv[1], "--checkpoint-interval") == 0) {
+            checkpoint_interval = atof(argv[2]);
+        } else if (strcmp(argv[1], "--listen") == 0) {
+            listen_port = atoi(argv[2]);
+        } else if (strcmp(argv[1], "--connect") == 0) {
+            coordinator = argv[2];
+        } else if (strcmp(argv[1], "--threads") == 0) {
+            num_workers = atoi(argv[2]);
+        } else if (strcmp(argv[1], "--isomorph-depth") == 0) {
+            isomorph_depth = atoi(argv[2]);
+        } else if (strcmp(argv[1], "--portfolio") == 0) {
+            portfolio.clear();
+            std::string list = argv[2];
+            for (size_t start = 0, comma; start <= list.size(); start = comma + 1) {
+                comma = std::min(list.find(',', start), list.size());
+                MaskOrder order;
+                portfolio_ok = portfolio_ok && parse_mask_order(list.substr(start, comma - start), &order);
+                portfolio.push_back(order);
+            }
+        } else if (strcmp(argv[1], "--restarts") == 0) {
+            restart_nodes = strtoull(argv[2], nullptr, 10);
+        } else if (strcmp(argv[1], "--dedicated") == 0) {
+            num_dedicated_workers = atoi(argv[2]);
+        } else if (strcmp(argv[1], "--long-shot") == 0) {
+            long_shot_seconds = atof(argv[2]);
+        } else if (strcmp(argv[1], "--display-interval") == 0) {
+            display_interval = atof(argv[2]);
+        } else if (strcmp(argv[1], "--status") == 0) {
+            status_filename = argv[2];
+        } else if (strcmp(argv[1], "--pin") == 0 && strcmp(argv[2], "none") == 0) {
+            pin = PinNone;
+        } else if (strcmp(argv[1], "--pin") == 0 && strcmp(argv[2], "cores") == 0) {
+            pin = PinCores;
+        } else if (strcmp(argv[1], "--pin") == 0 && strcmp(argv[2], "nodes") == 0) {
+            pin = PinNodes;
+        } else {
+            print_usage(argv0);
+            return 1;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc > 1 || num_workers < (listen_port ? 0 : 1) || (coordinator && listen_port) ||
+        isomorph_depth < 0 || (isomorph_depth != 0 && !solver_has_isomorph_rejection()) || !portfolio_ok ||
+        num_dedicated_workers < 0 || num_dedicated_workers > num_workers || (coordinator && num_dedicated_workers)) {
+        print_usage(argv0);
+        return 1;
+    }
+    signal(SIGINT, request_shutdown);
+    signal(SIGTERM, request_shutdown);
+
+    if (coordinator != nullptr) {
+        // Be a remote worker; the coordinator keeps the checkpoints.
+        WorkerConfig config{num_workers, "", checkpoint_interval, isomorph_depth, portfolio, restart_nodes};
+        while (!shutting_down) {
+            std::unique_ptr<Connection> conn = connect_to(coordinator);
+            if (conn != nullptr) {
+                serve_coordinator(*conn, config);
+            }
+            for (int i = 0; i < 50 && !shutting_down; ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        }
+        return 0;
+    }
+    int listen_fd = -1;
+    if (listen_port != 0 && (listen_fd = listen_on_port(listen_port)) < 0) {
+        return 1;
+    }
+    BoundsDB db(bounds_filename);
+
+    // Decide where each worker runs. A worker's candidate arrays are allocated
+    // by the worker itself (and by the solver threads it spawns, which inherit
+    // its affinity), so with pinning, first-touch places them on its own node.
+    std::vector<std::vector<int>> worker_cpus(num_workers);
+    std::vector<std::vector<int>> nodes = (pin == PinNone) ? std::vector<std::vector<int>>() : get_numa_nodes();
+    if (pin != PinNone && nodes.empty()) {
+        log_message("Can't determine which CPUs we may use; not pinning workers\n");
+        pin = PinNone;
+    }
+    if (pin == PinCores) {
+        std::vector<int> all_cpus;
+        for (int i = 0; all_cpus.size() < size_t(num_workers); ++i) {
+            // Interleave the nodes, so that a few workers spread across all of them.
+            for (auto&& node : nodes) {
+                if (i < node.size()) all_cpus.push_back(node[i]);
+            }
+            if (i >= CPU_SETSIZE) break;
+        }
+        int ncpus = 0;
+        for (auto&& node : nodes) ncpus += node.size();
+        for (int i = 0; i < num_workers; ++i) {
+            worker_cpus[i] = {all_cpus[i % ncpus]};
+        }
+    } else if (pin == PinNodes) {
+        for (int i = 0; i < num_workers; ++i) {
+            worker_cpus[i] = nodes[i % nodes.size()];
+        }
+    }
+
+    Triangle triangle(db);
+    triangle.long_shot_seconds = long_shot_seconds;
+    if (mkdir(checkpoint_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        log_message("%s: %s\n", checkpoint_dir.c_str(), strerror(errno));
+        return 1;
+    }
+    load_checkpoints(triangle, checkpoint_dir);
+    TaskQueue queue;
+    Mailbox mailbox;
+    SnapshotBoard board;
+    std::thread scheduler([&]() {
+        scheduler_thread(triangle, queue, mailbox, board, num_workers, num_dedicated_workers);
+    });
     std::thread printer([&]() {
-        printer_thread(triangle);
+        printer_thread(board, display_interval, status_filename);
     });
     std::vector<std::thread> workers;
-    for (int i=0; i < NUM_THREADS; ++i) {
-        workers.emplace_back([&]() {
-            while (true) {
-                worker_thread(triangle);
+    const int cores_per_worker = std::max(1, int(std::thread::hardware_concurrency()) / std::max(1, num_workers));
+    for (int i=0; i < num_workers; ++i) {
+        const std::vector<int>& cpus = worker_cpus[i];
+        // Unpinned workers share the cores out evenly, so that there's about
+        // one search thread per core (with the default of one worker per core,
+        // each searches its cell alone); pinned workers keep to the cores they
+        // were given.
+        WorkerConfig config{cpus.empty() ? cores_per_worker : int(cpus.size()), checkpoint_dir, checkpoint_interval,
+                            isomorph_depth, portfolio, restart_nodes};
+        // The last few workers are the dedicated ones.
+        bool dedicated = (i >= num_workers - num_dedicated_workers);
+        workers.emplace_back([&, config, dedicated]() {
+            if (!cpus.empty()) {
+                pin_current_thread(cpus);
+            }
+            Task task;
+            while (!shutting_down && queue.pop(&task, dedicated)) {
+                worker_thread(task, mailbox, config);
             }
         });
     }
-    printer.join();  // block forever
+    std::mutex remote_workers_mtx;
+    std::vector<std::thread> remote_workers;
+    if (listen_fd >= 0) {
+        log_message("Listening for workers on port %d\n", listen_port);
+        std::thread([&]() {
+            while (std::unique_ptr<Connection> conn = accept_connection(listen_fd)) {
+                std::lock_guard<std::mutex> lk(remote_workers_mtx);
+                remote_workers.emplace_back(remote_worker_thread, std::move(conn), std::ref(queue), std::ref(mailbox), checkpoint_dir);
+            }
+        }).detach();
+    }
+
+    while (!shutting_down) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    // Let every worker, local or remote, finish (or checkpoint) its current task.
+    queue.close();
+    for (auto&& th : workers) {
+        th.join();
+    }
+    std::lock_guard<std::mutex> lk(remote_workers_mtx);
+    for (auto&& th : remote_workers) {
+        th.join();
+    }
+    // The scheduler and printer never finish on their own.
+    log_message("Checkpoints saved; exiting\n");
+    flush_log();
+    fflush(stdout);
+    _exit(0);
 }
@@ -1,60 +1,142 @@
 
+#include <algorithm>
 #include <assert.h>
+#include <chrono>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <string>
+#include <thread>
 #include <vector>
+#include "bounds_db.h"
 #include "wolves.h"
 
+// Solve, and in a WOLVES_STATS build, say on stderr how the search went.
+static NktResult solve_and_report(int n, int k, int t, SolveOptions options)
+{
+#ifdef WOLVES_STATS
+    SearchStats stats;
+    options.stats = &stats;
+    auto start = std::chrono::steady_clock::now();
+    NktResult result = solve_wolves(n, k, t, options);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (stats.total_nodes() != 0) {
+        fprintf(stderr, "Searching n=%d, k=%d, t=%d: %s", n, k, t, format_search_stats(stats, elapsed.count()).c_str());
+    }
+    return result;
+#else
+    return solve_wolves(n, k, t, options);
+#endif
+}
+
 int main(int argc, char **argv)
 {
+    const char *bounds_filename = BoundsDB::default_filename;
+    if (argc >= 3 && strcmp(argv[1], "--bounds") == 0) {
+        bounds_filename = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+
+    // Even a single (n,k,t) cell is searched in parallel, one subtree per core.
+    SolveOptions options;
+    options.num_threads = std::max(1u, std::thread::hardware_concurrency());
+    if (argc >= 3 && strcmp(argv[1], "--isomorph-depth") == 0) {
+        if (!solver_has_isomorph_rejection()) {
+            printf("This ./st was built without nauty; rebuild it with \"make NAUTY=1\".\n");
+            exit(1);
+        }
+        options.isomorph_rejection_depth = atoi(argv[2]);
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc >= 3 && strcmp(argv[1], "--order") == 0) {
+        if (!parse_mask_order(argv[2], &options.mask_order)) {
+            printf("Unknown order \"%s\"; try numeric, balanced, informative or random.\n", argv[2]);
+            exit(1);
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    // A single cell can be searched past its first solution, to count them all or to print them all.
+    enum { FirstSolution, CountSolutions, PrintSolutions } mode = FirstSolution;
+    if (argc >= 2 && (strcmp(argv[1], "--count") == 0 || strcmp(argv[1], "--all") == 0)) {
+        mode = (strcmp(argv[1], "--count") == 0) ? CountSolutions : PrintSolutions;
+        argc -= 1;
+        argv += 1;
+    }
+    BoundsDB db(bounds_filename);
+    // Print each solution as a record that cm --records and wolfy can read back.
+    FILE *summary = (mode == PrintSolutions) ? stderr : stdout;
+    auto search_all = [&](int n, int k) {
+        options.on_solution = [mode, n, k](const std::vector<std::string>& tests) {
+            if (mode == PrintSolutions) {
+                printf("N=%d D=%d T=%zu guaranteed_best=0\n", n, k, tests.size());
+                for (auto&& test : tests) {
+                    std::string row = test;
+                    std::replace(row.begin(), row.end(), '0', '.');
+                    printf("%s\n", row.c_str());
+                }
+                printf("\n");
+            }
+            return true;
+        };
+    };
+
     if (argc == 4) {
         int n = atoi(argv[1]);
         int k = atoi(argv[2]);
         int t = atoi(argv[3]);
-        NktResult result = solve_wolves(n, k, t);
-        printf("%s\n", result.message.c_str());
+        if (mode != FirstSolution) {
+            search_all(n, k);
+        }
+        NktResult result = solve_and_report(n, k, t, options);
+        fprintf(summary, "%s\n", result.message.c_str());
+        if (mode != FirstSolution) {
+            fprintf(summary, "Found %llu solutions.\n", result.solutions);
+        }
+        if (result.success) {
+            db.report_positive_result(n, k, t);
+        } else {
+            db.report_negative_result(n, k, t);
+        }
     } else if (argc == 5) {
         int n = atoi(argv[1]);
         int k = atoi(argv[2]);
         int t = atoi(argv[3]);
-        int s = atoi(argv[4]);
-        NktResult result = solve_wolves(n, k, t, s);
-        printf("%s\n", result.message.c_str());
-    } else if (argc == 1 || argc == 2) {
-        int n = (argc == 2) ? atoi(argv[1]) : 0;
-        std::vector<int> triangle;
-        switch (n - 1) {
-            case -1: triangle = {}; break;
-            case  0: triangle = {0}; break;
-            case  1: triangle = {0,0}; break;
-            case  2: triangle = {0,1,0}; break;
-            case  3: triangle = {0,2,2,0}; break;
-            case  4: triangle = {0,2,3,3,0}; break;
-            case  5: triangle = {0,3,4,4,4,0}; break;
-            case  6: triangle = {0,3,5,5,5,5,0}; break;
-            case  7: triangle = {0,3,6,6,6,6,6,0}; break;
-            case  8: triangle = {0,3,6,7,7,7,7,7,0}; break;
-            case  9: triangle = {0,4,7,8,8,8,8,8,8,0}; break;
-            case 10: triangle = {0,4,7,9,9,9,9,9,9,9,0}; break;
-            case 11: triangle = {0,4,8,10,10,10,10,10,10,10,10,0}; break;
-            case 12: triangle = {0,4,8,11,11,11,11,11,11,11,11,11,0}; break;
-            case 13: triangle = {0,4,8,12,12,12,12,12,12,12,12,12,12,0}; break;
-            default: {
-                printf("Precomputed triangle rows are known only up to n=13.\n");
-                exit(1);
-            }
+        options.test_population = atoi(argv[4]);
+        if (mode != FirstSolution) {
+            search_all(n, k);
+        }
+        NktResult result = solve_and_report(n, k, t, options);
+        fprintf(summary, "%s\n", result.message.c_str());
+        if (mode != FirstSolution) {
+            fprintf(summary, "Found %llu solutions.\n", result.solutions);
         }
-        for ( ; true; ++n) {
+    } else if (argc == 1 && mode == FirstSolution) {
+        // Rows the bounds database already settles just print; the first cell it
+        // doesn't is where the searching starts.
+        std::vector<int> triangle;
+        for (int n = 0; true; ++n) {
             triangle.push_back(0);
             for (int k = 0; k <= n; ++k) {
-                for (int t = triangle[k]; t <= n-1; ++t) {
-                    NktResult result = solve_wolves(n, k, t);
+                // Skip past anything we've already (perhaps in an earlier run) proven impossible.
+                for (int t = std::max(triangle[k], db.lower_bound(n, k)); t <= n-1; ++t) {
+                    if (db.upper_bound(n, k) <= t) {
+                        if (db.lower_bound(n, k) < t) {
+                            printf("We already know how to do (%d,%d) in %d tests.\n", n, k, t);
+                        }
+                        triangle[k] = t;
+                        break;
+                    }
+                    NktResult result = solve_and_report(n, k, t, options);
                     printf("%s", result.message.c_str());
                     if (result.success) {
+                        db.report_positive_result(n, k, t);
                         triangle[k] = t;
                         break;
                     }
+                    db.report_negative_result(n, k, t);
                 }
             }
             printf("SUCCESS: ");
@@ -63,9 +145,15 @@ int main(int argc, char **argv)
         }
     } else {
         printf("Usage:\n");
+        printf("  ./st [--bounds f.txt] ...  -- record proven bounds in this file (default %s)\n", BoundsDB::default_filename);
+        printf("  ./st [--bounds f.txt] --isomorph-depth D ...  -- skip any prefix of up to D tests that\n");
+        printf("                               is a permutation of one already searched (make NAUTY=1)\n");
+        printf("  ./st [--bounds f.txt] [--isomorph-depth D] --order O ...  -- try each level's tests in\n");
+        printf("                               order O: numeric (the default), balanced, informative or random\n");
         printf("  ./st n k t   -- solve (n,k) in t tests\n");
         printf("  ./st n k t s -- ...each involving s animals\n");
-        printf("  ./st         -- print the triangle of solutions t(n,k)\n");
-        printf("  ./st r       -- ...having precomputed the first r rows\n");
+        printf("  ./st [...] --count n k t [s]  -- ...and count every solution the search finds\n");
+        printf("  ./st [...] --all n k t [s]    -- ...and print them all, as solution records\n");
+        printf("  ./st         -- print the triangle of solutions t(n,k), carrying on from the bounds file\n");
     }
 }
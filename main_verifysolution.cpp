@@ -1,68 +1,83 @@
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cstdint>
 #include <set>
-#include <map>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <tuple>
 #include <vector>
-#if USE_MEMORY_RESOURCE
-#include <memory_resource>
+
+#include "combinatorics.h"
+
+#ifdef WOLVES_CUDA
+#include "test_matrix.h"
+#include "verify_strategy.h"
 #endif
 
 using Int = unsigned long long;
 
-template<int n, int k>
-static constexpr Int choose() {
-    Int grid[n+1][k+1] = {};
-    auto compute = [&](int ni, int ki) {
-        if (ki > ni) return Int(0);
-        if (ki == 0 || ki == ni) return Int(1);
-        if (ki == 1 || ki == ni-1) return Int(ni);
-        if (ni-1 < 0) throw;
-        if (ki-1 < 0) throw;
-        return grid[ni-1][ki] + grid[ni-1][ki-1];
-    };
-    for (int i = 0; i < n+k+2; ++i) {
-        for (int ni = 0; ni <= i && ni <= n; ++ni) {
-            int ki = i - ni;
-            if (ki <= k) {
-                grid[ni][ki] = compute(ni, ki);
-            }
-        }
-    }
-    return grid[n][k];
-}
-
+// Bit j of word j/64 of a column is test j, as in StrategyTable below.
 template<class TS, class = void>
 struct TestResults {
-    std::vector<bool> data_;
-    void push_back(bool b) {
-        data_.push_back(b);
+    std::array<uint64_t, (TS::t + 63) / 64> data_ = {};
+    static TestResults from_words(const uint64_t *words) {
+        TestResults r;
+        std::copy(words, words + r.data_.size(), r.data_.begin());
+        return r;
+    }
+    TestResults& operator|=(const TestResults& rhs) {
+        for (size_t i = 0; i < data_.size(); ++i) {
+            data_[i] |= rhs.data_[i];
+        }
+        return *this;
     }
     friend bool operator<(const TestResults& a, const TestResults& b) {
         return a.data_ < b.data_;
     }
+    friend bool operator==(const TestResults& a, const TestResults& b) {
+        return a.data_ == b.data_;
+    }
 };
 template<class TS>
 struct TestResults<TS, std::enable_if_t<(TS::t <= 64)>> {
-    uint64_t data_;
-    void push_back(bool b) {
-        data_ <<= 1;
-        data_ |= uint64_t(b);
+    uint64_t data_ = 0;
+    static TestResults from_words(const uint64_t *words) {
+        TestResults r;
+        r.data_ = (TS::t == 0) ? 0 : words[0];
+        return r;
+    }
+    TestResults& operator|=(const TestResults& rhs) {
+        data_ |= rhs.data_;
+        return *this;
     }
     friend bool operator<(const TestResults& a, const TestResults& b) {
         return a.data_ < b.data_;
     }
+    friend bool operator==(const TestResults& a, const TestResults& b) {
+        return a.data_ == b.data_;
+    }
 };
 template<class TS>
 struct TestResults<TS, std::enable_if_t<(64 < TS::t && TS::t <= 128)>> {
-    unsigned __int128 data_;
-    void push_back(bool b) {
-        data_ <<= 1;
-        data_ |= (unsigned __int128)(b);
+    unsigned __int128 data_ = 0;
+    static TestResults from_words(const uint64_t *words) {
+        TestResults r;
+        r.data_ = words[0] | ((unsigned __int128)(words[1]) << 64);
+        return r;
+    }
+    TestResults& operator|=(const TestResults& rhs) {
+        data_ |= rhs.data_;
+        return *this;
     }
     friend bool operator<(const TestResults& a, const TestResults& b) {
         return a.data_ < b.data_;
     }
+    friend bool operator==(const TestResults& a, const TestResults& b) {
+        return a.data_ == b.data_;
+    }
 };
 
 struct WolfArrangement {
@@ -79,49 +94,17 @@ struct WolfArrangement {
         return false;
     }
 
+    // Returns the index of the wolf that moved; the ones below it have been reset.
     template<class TS>
-    bool test_is_wolfy(int t) const {
-        for (int i : v_) {
-            if (TS::test_contains_animal(t, i)) {
-                return true;
-            }
-        }
-        return false;
-    }
-
-    template<class TS>
-    void increment() {
-        // Increment the first possible animal index,
-        // and then reset all the previous ones.
-        const int k = v_.size();
-        for (int i=0; i < k-1; ++i) {
-            if (v_[i] + 1 < v_[i+1]) {
-                v_[i] += 1;
-                for (int j = 0; j < i; ++j) {
-                    v_[j] = j;
-                }
-                return;
-            }
-        }
-        if (v_[k-1] + 1 < TS::n) {
-            v_[k-1] += 1;
-            for (int j = 0; j < k-1; ++j) {
-                v_[j] = j;
-            }
-            return;
-        }
-        // Otherwise, increment is impossible.
-        assert(false);
-    }
+    int increment() { return next_arrangement(v_.data(), v_.size(), TS::n); }
 };
 
+// increment() visits the arrangements in colex order, so we can unrank the
+// id of an arrangement directly.
 template<class TS>
-WolfArrangement wolf_arrangement_from_index(int id) {
-    assert((0 <= id && id < choose<TS::n, TS::k>()));
+WolfArrangement wolf_arrangement_from_index(Int id) {
     WolfArrangement result(TS::k);
-    for (int i=0; i < id; ++i) {
-        result.increment<TS>();
-    }
+    unrank_arrangement(id, TS::n, TS::k, result.v_.data());
     return result;
 }
 
@@ -129,7 +112,7 @@ struct T_8_2 {
     static constexpr int n = 8;
     static constexpr int k = 2;
     static constexpr int t = 6;
-    static bool test_contains_animal(int t, int i) {
+    static constexpr bool test_contains_animal(int t, int i) {
         switch (t) {
             case 0: return "T..TT..."[i] == 'T';
             case 1: return "T....TT."[i] == 'T';
@@ -147,7 +130,7 @@ struct T_14_3 {
     static constexpr int n = 14;
     static constexpr int k = 3;
     static constexpr int t = 12;
-    static bool test_contains_animal(int t, int i) {
+    static constexpr bool test_contains_animal(int t, int i) {
         switch (i) {
             case  0: return "100000001100"[t] == '1';
             case  1: return "000001010001"[t] == '1';
@@ -180,37 +163,22 @@ static constexpr bool T_100_5_test_contains_animal_(int t, int i) {
     }
     assert(false);
 }
-struct T_100_5_cache {
-    char data_[63][100];
-};
-static constexpr T_100_5_cache T_100_5_cacheit_() {
-    T_100_5_cache result {};
-    for (int j = 0; j < 63; ++j) {
-        for (int i = 0; i < 100; ++i) {
-            result.data_[j][i] = T_100_5_test_contains_animal_(j, i);
-        }
-    }
-    return result;
-}
 struct T_100_5_noedne {
     static constexpr int n = 100;
     static constexpr int k = 5;
     static constexpr int t = 63;
 
-    static constexpr const T_100_5_cache cached_ = T_100_5_cacheit_();
-
-    static bool test_contains_animal(int t, int i) {
-        return cached_.data_[t][i];
+    static constexpr bool test_contains_animal(int t, int i) {
+        return T_100_5_test_contains_animal_(t, i);
     }
 };
-const T_100_5_cache T_100_5_noedne::cached_;
 
 struct T_111_3 {
     static constexpr int n = 111;
     static constexpr int k = 3;
     static constexpr int t = 37;
 
-    static bool test_contains_animal(int t, int n) {
+    static constexpr bool test_contains_animal(int t, int n) {
         // Each animal n is tested exactly 4 times;
         // no pair of animals is tested twice together.
         // Thanks to @Elaqqad for this example!
@@ -262,36 +230,40 @@ struct T_273_5_helper {
         return false;
     }
 
-    static constexpr int count_useful_tests(int n) {
-        int count = 0;
+    // The tests that some animal below n is in, in order.
+    struct UsefulTests {
+        int count;
+        int test[91];
+    };
+
+    static constexpr UsefulTests useful_tests(int n) {
+        UsefulTests result {};
         for (int t=0; t < 91; ++t) {
-            count += test_should_be_run(t, n);
+            if (test_should_be_run(t, n)) {
+                result.test[result.count++] = t;
+            }
         }
-        return count;
+        return result;
     };
 };
 
 struct T_273_5 : T_273_5_helper {
     static constexpr int n = 100;  // works for up to 273
     static constexpr int k = 5;
-    static constexpr int t = count_useful_tests(n);
+    static constexpr UsefulTests useful_ = useful_tests(n);
+    static constexpr int t = useful_.count;
 
-    static bool test_contains_animal(int t, int i) {
-        for (int tt = 0; tt < 91; ++tt) {
-            if (test_should_be_run(tt, n)) {
-                if (t-- == 0) {
-                    return T_273_5_helper::test_contains_animal(tt, i);
-                }
-            }
-        }
-        assert(false);
+    static constexpr bool test_contains_animal(int t, int i) {
+        return T_273_5_helper::test_contains_animal(useful_.test[t], i);
     }
 };
+constexpr T_273_5_helper::UsefulTests T_273_5::useful_;
 
 struct T_96_5 {
     static constexpr int n = 96;
     static constexpr int k = 5;
     static constexpr int t = 60;
+    static constexpr bool built_at_runtime = true;
 
     struct Point {
         // a in {0, 1}
@@ -367,6 +339,7 @@ struct T_100_5_elaqqad {
     static constexpr int n = 100;
     static constexpr int k = 5;
     static constexpr int t = 59;  // if t=60, this works for n=104
+    static constexpr bool built_at_runtime = true;
 
     struct Point {
         // a in {0, 1}
@@ -470,79 +443,79 @@ struct T_100_5_elaqqad_for_dummies {
     static constexpr int n = 100;
     static constexpr int k = 5;
     static constexpr int t = 59;
-    static bool test_contains_animal(int t, int i) {
-        static const char m[59][101] = {
-            "11111111111.........................................................................................",
-            "1..........1111111111...............................................................................",
-            "1....................1111111111.....................................................................",
-            "1..............................1111111111...........................................................",
-            "1........................................1111111111.................................................",
-            "1..................................................1111111111.......................................",
-            "1............................................................1111111111.............................",
-            "1......................................................................1111111111...................",
-            ".1.........1.........1.........1.........1.........1.........1.........1.........111................",
-            "..1.........1.........1.........1.........1.........1.........1.........1........1..11..............",
-            "...1.........1.........1.........1.........1.........1.........1.........1.......1....11............",
-            "....1.........1.........1.........1.........1.........1.........1.........1......1......11..........",
-            ".....1.........1.........1.........1.........1.........1.........1.........1.....1........11........",
-            "......1.........1.........1.........1.........1.........1.........1.........1....1..........11......",
-            ".......1.........1.........1.........1.........1.........1.........1.........1...1............11....",
-            "........1.........1.........1.........1.........1.........1.........1.........1..1..............11..",
-            "....1..............1.......1....1................1.....1............1.......1.....1...1.............",
-            "........1......1.............1......1....1.................1.......1......1.........1.1.............",
-            "....1.............1...........1.....1.....1..............1...........1.....1.......1...1............",
-            ".....1.....1............1..............1.........1........1.......1..........1.......1.1............",
-            "...1........1.............1.............1....1...........1............1.......1...1.....1...........",
-            ".........1.......1.....1...........1..............1.......1..1..............1.......1...1...........",
-            "..........1.....1..........1.......1............1...........1.1..........1.........1.....1..........",
-            "......1...........1..........1.......1.......1.......1.......1.................1.....1...1..........",
-            "......1.............1.......1.....1........1...............1..1..............1....1.......1.........",
-            "..........1.1................1........1........1...1............1...........1..........1..1.........",
-            "........1....1........1.................1.........1.....1.......1............1.....1.......1........",
-            ".........1.1..................1......1........1.......1.......1...............1.......1....1........",
-            "..........11................1....1..........1............1.......1..............1...1.......1.......",
-            "..1................1.1..................1..1..............1........1.......1.............1..1.......",
-            ".......1...........1.....1.......1.......1..................1...1.............1......1.......1......",
-            "........1...........1......1...........1..1..........1...........1.....1................1....1......",
-            "...1............1...........1..1..................1....1.............1....1..........1........1.....",
-            ".1.............1..............1.......1....1................1.....1.....1...............1.....1.....",
-            ".........1....1......1...........1........1.............1...........1..........1..........1...1.....",
-            ".....1.......1...............1..1...............1.....1...............11....................1.1.....",
-            ".1................1......1........1..............1......1.............1..1..........1..........1....",
-            "...1...........1......1................1......1....1................1...........1........1.....1....",
-            "......1............1...1..............1.....1.......1................1.1...................1...1....",
-            ".........1..1...........1......1................1..........1...1...........1.................1.1....",
-            ".......1......1........1........1............1.............1......1.............1..1............1...",
-            ".1..............1.......1...............1......1....1............1.............1......1.........1...",
-            "..1..............1........1............1.1............1..............1...1................1.....1...",
-            "....1...............1....1...........1............11...........1........1...................1...1...",
-            ".....1...........1....1.............1.......1...............1..1...............1..1..............1..",
-            ".......1............11.............1..........1.....1.................1...1............1.........1..",
-            "..........1...1...........1....1.................1...1.............1....1..................1.....1..",
-            "..1..........1................1...1............1.......1.....1..................1............1...1..",
-            "...1..........1..........1..........1..........1..........1...1........1..........................1.",
-            "........1...1........1...............1......1..........1..........1......1........................1.",
-            ".1...............1..........1...1.............1......1..........1..........1......................1.",
-            "....1..........1..........1......1..............1...1........1...............1....................1.",
-            ".........1..........1........1..........1........1..........1........1..........1.................1.",
-            "..................................................................................1.1..1.1.1.11.1.1.",
-            "......1......1..........1..........1.....1...............1..........1...1..........................1",
-            "..1........1...............1..........1......1..........1......1..........1........................1",
-            ".......1..........1...1........1...........1..........1..........1..........1......................1",
-            "..........1........1..........1........1..........1........1..........1........1...................1",
-            "...................................................................................1.11.1.1.1..1.1.1",
-        };
-        return m[t][i] == '1';
+    static constexpr char m_[59][101] = {
+        "11111111111.........................................................................................",
+        "1..........1111111111...............................................................................",
+        "1....................1111111111.....................................................................",
+        "1..............................1111111111...........................................................",
+        "1........................................1111111111.................................................",
+        "1..................................................1111111111.......................................",
+        "1............................................................1111111111.............................",
+        "1......................................................................1111111111...................",
+        ".1.........1.........1.........1.........1.........1.........1.........1.........111................",
+        "..1.........1.........1.........1.........1.........1.........1.........1........1..11..............",
+        "...1.........1.........1.........1.........1.........1.........1.........1.......1....11............",
+        "....1.........1.........1.........1.........1.........1.........1.........1......1......11..........",
+        ".....1.........1.........1.........1.........1.........1.........1.........1.....1........11........",
+        "......1.........1.........1.........1.........1.........1.........1.........1....1..........11......",
+        ".......1.........1.........1.........1.........1.........1.........1.........1...1............11....",
+        "........1.........1.........1.........1.........1.........1.........1.........1..1..............11..",
+        "....1..............1.......1....1................1.....1............1.......1.....1...1.............",
+        "........1......1.............1......1....1.................1.......1......1.........1.1.............",
+        "....1.............1...........1.....1.....1..............1...........1.....1.......1...1............",
+        ".....1.....1............1..............1.........1........1.......1..........1.......1.1............",
+        "...1........1.............1.............1....1...........1............1.......1...1.....1...........",
+        ".........1.......1.....1...........1..............1.......1..1..............1.......1...1...........",
+        "..........1.....1..........1.......1............1...........1.1..........1.........1.....1..........",
+        "......1...........1..........1.......1.......1.......1.......1.................1.....1...1..........",
+        "......1.............1.......1.....1........1...............1..1..............1....1.......1.........",
+        "..........1.1................1........1........1...1............1...........1..........1..1.........",
+        "........1....1........1.................1.........1.....1.......1............1.....1.......1........",
+        ".........1.1..................1......1........1.......1.......1...............1.......1....1........",
+        "..........11................1....1..........1............1.......1..............1...1.......1.......",
+        "..1................1.1..................1..1..............1........1.......1.............1..1.......",
+        ".......1...........1.....1.......1.......1..................1...1.............1......1.......1......",
+        "........1...........1......1...........1..1..........1...........1.....1................1....1......",
+        "...1............1...........1..1..................1....1.............1....1..........1........1.....",
+        ".1.............1..............1.......1....1................1.....1.....1...............1.....1.....",
+        ".........1....1......1...........1........1.............1...........1..........1..........1...1.....",
+        ".....1.......1...............1..1...............1.....1...............11....................1.1.....",
+        ".1................1......1........1..............1......1.............1..1..........1..........1....",
+        "...1...........1......1................1......1....1................1...........1........1.....1....",
+        "......1............1...1..............1.....1.......1................1.1...................1...1....",
+        ".........1..1...........1......1................1..........1...1...........1.................1.1....",
+        ".......1......1........1........1............1.............1......1.............1..1............1...",
+        ".1..............1.......1...............1......1....1............1.............1......1.........1...",
+        "..1..............1........1............1.1............1..............1...1................1.....1...",
+        "....1...............1....1...........1............11...........1........1...................1...1...",
+        ".....1...........1....1.............1.......1...............1..1...............1..1..............1..",
+        ".......1............11.............1..........1.....1.................1...1............1.........1..",
+        "..........1...1...........1....1.................1...1.............1....1..................1.....1..",
+        "..1..........1................1...1............1.......1.....1..................1............1...1..",
+        "...1..........1..........1..........1..........1..........1...1........1..........................1.",
+        "........1...1........1...............1......1..........1..........1......1........................1.",
+        ".1...............1..........1...1.............1......1..........1..........1......................1.",
+        "....1..........1..........1......1..............1...1........1...............1....................1.",
+        ".........1..........1........1..........1........1..........1........1..........1.................1.",
+        "..................................................................................1.1..1.1.1.11.1.1.",
+        "......1......1..........1..........1.....1...............1..........1...1..........................1",
+        "..1........1...............1..........1......1..........1......1..........1........................1",
+        ".......1..........1...1........1...........1..........1..........1..........1......................1",
+        "..........1........1..........1........1..........1........1..........1........1...................1",
+        "...................................................................................1.11.1.1.1..1.1.1",
+    };
+    static constexpr bool test_contains_animal(int t, int i) {
+        return m_[t][i] == '1';
     }
-
 };
+constexpr char T_100_5_elaqqad_for_dummies::m_[59][101];
 
 struct T_26_3 {
     static constexpr int n = 26;
     static constexpr int k = 3;
     static constexpr int t = 19;
 
-    static bool test_contains_animal(int t, int i) {
+    static constexpr bool test_contains_animal(int t, int i) {
         if (i == 25) return false;
         switch (t / 5) {
             case 0: return (t % 5) == ((i+0*(i/5)) % 5);
@@ -559,7 +532,7 @@ struct T_21_3 {
     static constexpr int k = 3;
     static constexpr int t = 18;
 
-    static bool test_contains_animal(int t, int i) {
+    static constexpr bool test_contains_animal(int t, int i) {
         if (i == 20) return false;
         switch (t / 5) {
             case 0: return (t % 5) == ((i+0*(i/5)) % 5);
@@ -576,7 +549,7 @@ struct T_17_3 {
     static constexpr int k = 3;
     static constexpr int t = 15;
 
-    static bool test_contains_animal(int t, int i) {
+    static constexpr bool test_contains_animal(int t, int i) {
         if (i == 16) return false;
         switch (t / 4) {
             case 0: return (t % 4) == "aaaabbbbccccdddd"[i] - 'a';
@@ -588,6 +561,53 @@ struct T_17_3 {
     }
 };
 
+// Each animal's column of tests, with test j in bit j of word j/64.
+template<class TS>
+struct Columns {
+    static constexpr int words = (TS::t + 63) / 64;
+    uint64_t bits[TS::n][words ? words : 1];
+};
+
+template<class TS>
+static constexpr Columns<TS> compute_columns() {
+    Columns<TS> result {};
+    for (int i = 0; i < TS::n; ++i) {
+        for (int t = 0; t < TS::t; ++t) {
+            if (TS::test_contains_animal(t, i)) {
+                result.bits[i][t / 64] |= uint64_t(1) << (t % 64);
+            }
+        }
+    }
+    return result;
+}
+
+// Nearly every strategy's test_contains_animal is constexpr, and its columns
+// are worked out by the compiler; the ones that need containers to build
+// (marked with built_at_runtime) work theirs out once, at startup.
+template<class TS, class = void>
+struct StrategyTable {
+    static constexpr Columns<TS> columns = compute_columns<TS>();
+};
+template<class TS, class V>
+constexpr Columns<TS> StrategyTable<TS, V>::columns;
+
+template<class TS>
+struct StrategyTable<TS, std::enable_if_t<TS::built_at_runtime>> {
+    static const Columns<TS> columns;
+};
+template<class TS>
+const Columns<TS> StrategyTable<TS, std::enable_if_t<TS::built_at_runtime>>::columns = compute_columns<TS>();
+
+template<class TS>
+TestResults<TS> column(int i) {
+    return TestResults<TS>::from_words(StrategyTable<TS>::columns.bits[i]);
+}
+
+template<class TS>
+bool test_contains_animal(int t, int i) {
+    return (StrategyTable<TS>::columns.bits[i][t / 64] >> (t % 64)) & 1;
+}
+
 template<class TS>
 void print_wolves(const WolfArrangement& w) {
     for (int i=0; i < TS::n; ++i) {
@@ -602,33 +622,114 @@ void print_wolves(const WolfArrangement& w) {
 
 template<class TS>
 TestResults<TS> run_tests(const WolfArrangement& w) {
-    TestResults<TS> r;
-    for (int i=0; i < TS::t; ++i) {
-        r.push_back(w.test_is_wolfy<TS>(i));
+    const uint64_t zeros[Columns<TS>::words + 1] = {};
+    TestResults<TS> r = TestResults<TS>::from_words(zeros);
+    for (int i : w.v_) {
+        r |= column<TS>(i);
     }
     return r;
 }
 
+// Sort the chunks on a thread apiece, then merge neighbouring runs
+// pairwise (again in parallel) until one run is left.
+template<class T>
+void parallel_sort(std::vector<T>& v, int num_threads) {
+    const size_t num_chunks = std::max(1, num_threads);
+    std::vector<size_t> bounds;
+    for (size_t i = 0; i <= num_chunks; ++i) {
+        bounds.push_back(v.size() * i / num_chunks);
+    }
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_chunks; ++i) {
+        threads.emplace_back([&, i]() {
+            std::sort(v.begin() + bounds[i], v.begin() + bounds[i+1]);
+        });
+    }
+    for (auto&& th : threads) th.join();
+
+    while (bounds.size() > 2) {
+        std::vector<size_t> merged_bounds;
+        threads.clear();
+        for (size_t i = 0; i + 1 < bounds.size(); i += 2) {
+            merged_bounds.push_back(bounds[i]);
+            if (i + 2 < bounds.size()) {
+                threads.emplace_back([&, i]() {
+                    std::inplace_merge(v.begin() + bounds[i], v.begin() + bounds[i+1], v.begin() + bounds[i+2]);
+                });
+            }
+        }
+        merged_bounds.push_back(bounds.back());
+        for (auto&& th : threads) th.join();
+        bounds = std::move(merged_bounds);
+    }
+}
+
+// Compute every arrangement's test results into one flat array and sort it;
+// two equal neighbours are two arrangements that the tests can't tell apart.
+// Each thread fills in one contiguous range of the array, starting from
+// the arrangement at the start of its range.
+//
+// Rather than ask about every test and wolf, we OR together the wolves'
+// columns from the StrategyTable. above[i] is the OR of the columns of
+// wolves i and up, and an increment only disturbs the entries at and
+// below the wolf that moved; on average that's O(1) ORs per arrangement.
 template<class TS>
-bool verify_strategy() {
-    WolfArrangement wolves(TS::k);
-#if USE_MEMORY_RESOURCE
-    std::pmr::map<TestResults<TS>, int> tr;
-#else
-    std::map<TestResults<TS>, int> tr;
-#endif
-    tr.insert(std::make_pair(run_tests<TS>(wolves), 0));
-    for (Int id=1; id < choose<TS::n, TS::k>(); ++id) {
-        wolves.increment<TS>();
-        auto ii = tr.insert(std::make_pair(run_tests<TS>(wolves), id));
-        if (ii.second == false) {
-            printf("Failure! These wolf arrangements cannot be distinguished:\n");
-            print_wolves<TS>(wolf_arrangement_from_index<TS>(ii.first->second));
-            print_wolves<TS>(wolves);
-            return false;
+bool verify_strategy(int num_threads) {
+    const Int n_choose_k = choose(TS::n, TS::k);
+    std::vector<TestResults<TS>> columns;
+    for (int i = 0; i < TS::n; ++i) {
+        columns.push_back(column<TS>(i));
+    }
+    const TestResults<TS> none = run_tests<TS>(WolfArrangement(0));
+
+    std::vector<TestResults<TS>> all_results(n_choose_k);
+    if (n_choose_k < Int(num_threads)) {
+        num_threads = 1;
+    }
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+        Int begin = n_choose_k / num_threads * i;
+        Int end = (i == num_threads - 1) ? n_choose_k : n_choose_k / num_threads * (i+1);
+        threads.emplace_back([&, begin, end]() {
+            WolfArrangement wolves = wolf_arrangement_from_index<TS>(begin);
+            std::vector<TestResults<TS>> above(TS::k + 1, none);
+            int moved = TS::k - 1;
+            for (Int id = begin; id < end; ++id) {
+                if (id != begin) {
+                    moved = wolves.increment<TS>();
+                }
+                for (int i = moved; i >= 0; --i) {
+                    above[i] = above[i+1];
+                    above[i] |= columns[wolves.v_[i]];
+                }
+                all_results[id] = above[0];
+            }
+        });
+    }
+    for (auto&& th : threads) th.join();
+
+    parallel_sort(all_results, num_threads);
+    auto it = std::adjacent_find(all_results.begin(), all_results.end());
+    if (it == all_results.end()) {
+        return true;
+    }
+
+    // Go back for the first two arrangements that gave those results.
+    TestResults<TS> duplicate = *it;
+    all_results = std::vector<TestResults<TS>>();
+    printf("Failure! These wolf arrangements cannot be distinguished:\n");
+    WolfArrangement w(TS::k);
+    int found = 0;
+    for (Int id=0; found < 2; ++id) {
+        if (id != 0) {
+            w.increment<TS>();
+        }
+        if (run_tests<TS>(w) == duplicate) {
+            print_wolves<TS>(w);
+            found += 1;
         }
     }
-    return true;
+    return false;
 }
 
 template<class TS>
@@ -638,20 +739,106 @@ void print_strategy(bool line_numbers) {
             printf("    %2d ", i+1);
         }
         for (int sheep = 0; sheep < TS::n; ++sheep) {
-            bool this_sheep_is_used = TS::test_contains_animal(i, sheep);
+            bool this_sheep_is_used = test_contains_animal<TS>(i, sheep);
             printf("%c", this_sheep_is_used ? '1' : '.');
         }
         printf("\n");
     }
 }
 
-int main() {
-#if USE_MEMORY_RESOURCE
-    std::pmr::monotonic_buffer_resource mr(1'000'000);
-    std::pmr::set_default_resource(&mr);
+#ifdef WOLVES_CUDA
+// The same check, made by the library's verify_strategy on the GPU from a
+// TestMatrix of the strategy's columns.
+template<class TS>
+bool verify_strategy_on_gpu(int num_threads) {
+    TestMatrix tests(TS::t, TS::n);
+    for (int i = 0; i < TS::n; ++i) {
+        for (int t = 0; t < TS::t; ++t) {
+            if (test_contains_animal<TS>(t, i)) {
+                tests.set(t, i, true);
+            }
+        }
+    }
+    VerifyStrategyResult r = verify_strategy(tests, TS::k, VerifyMethod::Gpu, num_threads);
+    if (!r.success) {
+        printf("Failure! These wolf arrangements cannot be distinguished:\n");
+        printf("%s\n%s\n", r.w1.c_str(), r.w2.c_str());
+    }
+    return r.success;
+}
 #endif
-    using T = T_26_3;
-    if (verify_strategy<T>()) {
-        print_strategy<T>(false);
+
+template<class TS>
+int verify_and_print(int num_threads, bool on_gpu) {
+#ifdef WOLVES_CUDA
+    bool ok = on_gpu ? verify_strategy_on_gpu<TS>(num_threads) : verify_strategy<TS>(num_threads);
+#else
+    assert(!on_gpu);
+    bool ok = verify_strategy<TS>(num_threads);
+#endif
+    if (!ok) {
+        return 1;
+    }
+    print_strategy<TS>(false);
+    return 0;
+}
+
+// Every strategy vs knows, by name.
+struct BuiltInStrategy {
+    const char *name;
+    int n, k, t;
+    int (*verify_and_print)(int num_threads, bool on_gpu);
+};
+
+template<class TS>
+static constexpr BuiltInStrategy built_in(const char *name) {
+    return BuiltInStrategy{ name, TS::n, TS::k, TS::t, verify_and_print<TS> };
+}
+
+static const BuiltInStrategy built_in_strategies[] = {
+    built_in<T_8_2>("T_8_2"),
+    built_in<T_14_3>("T_14_3"),
+    built_in<T_17_3>("T_17_3"),
+    built_in<T_21_3>("T_21_3"),
+    built_in<T_26_3>("T_26_3"),
+    built_in<T_111_3>("T_111_3"),
+    built_in<T_96_5>("T_96_5"),
+    built_in<T_100_5_noedne>("T_100_5_noedne"),
+    built_in<T_100_5_elaqqad>("T_100_5_elaqqad"),
+    built_in<T_100_5_elaqqad_for_dummies>("T_100_5_elaqqad_for_dummies"),
+    built_in<T_273_5>("T_273_5"),
+};
+
+int main(int argc, char **argv) {
+    int num_threads = std::max(1u, std::thread::hardware_concurrency());
+    if (argc >= 3 && !strcmp(argv[1], "--threads")) {
+        num_threads = std::max(1, atoi(argv[2]));
+        argc -= 2;
+        argv += 2;
+    }
+    bool on_gpu = false;
+#ifdef WOLVES_CUDA
+    if (argc >= 2 && !strcmp(argv[1], "--gpu")) {
+        on_gpu = true;
+        argc -= 1;
+        argv += 1;
+    }
+#endif
+    if (argc >= 2 && !strcmp(argv[1], "--list")) {
+        for (const BuiltInStrategy& s : built_in_strategies) {
+            printf("%-28s n=%d k=%d t=%d\n", s.name, s.n, s.k, s.t);
+        }
+        return 0;
+    }
+    const char *name = (argc >= 2) ? argv[1] : "T_26_3";
+    for (const BuiltInStrategy& s : built_in_strategies) {
+        if (!strcmp(name, s.name)) {
+            return s.verify_and_print(num_threads, on_gpu);
+        }
     }
+    fprintf(stderr, "Usage: vs [--threads N] [--gpu] [--list | STRATEGY]\n");
+    fprintf(stderr, "  Verify that STRATEGY (default T_26_3) distinguishes every arrangement of k wolves,\n");
+    fprintf(stderr, "  on N threads (default: one per core). --list lists the strategies.\n");
+    fprintf(stderr, "  --gpu verifies on a CUDA device instead, in a vs built with \"make CUDA=1\".\n");
+    return 2;
 }
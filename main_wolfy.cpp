@@ -1,36 +1,96 @@
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <map>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "bounds_db.h"
+#include "local_search.h"
+#include "solution_file.h"
+#include "solution_store.h"
+#include "test_matrix.h"
 #include "verify_strategy.h"
 
 enum class GuaranteedBest { Yes=1, No=0 };
 enum class BelongsInFile { Yes=1, No=0 };
 
+// How a derived strategy was made from the one it came from.
+enum class Derivation {
+    None,              // not derived: its tests are given, or generated on demand
+    TestLastAnimal,    // one more animal, in a test of its own
+    DropSheep,         // one animal fewer, known to be a sheep
+    DropWolf,          // one animal fewer, known to be a wolf, and the tests it was in
+    Same,              // the same tests, for one wolf fewer
+};
+
+// Strategies form a DAG: each derived one points at the strategy it came
+// from and says how it differs, and several can share a parent. Asking one
+// for its tests walks back to the nearest strategy whose tests we have,
+// and builds the answer from those in a single pass, so a strategy derived
+// k steps away costs one matrix, not k of them.
 struct Strategy {
-    std::function<std::vector<std::string>()> tests;
     int t;
     GuaranteedBest guaranteed_best;
     BelongsInFile belongs_in_file;
 
-    explicit Strategy(std::vector<std::string> testvec, GuaranteedBest gb, BelongsInFile bf) :
-        t(testvec.size()), guaranteed_best(gb), belongs_in_file(bf)
+    // Strategies read from the file hand out the same matrix every time.
+    explicit Strategy(TestMatrix matrix, GuaranteedBest gb, BelongsInFile bf) :
+        t(matrix.num_tests()), guaranteed_best(gb), belongs_in_file(bf)
+    {
+        memo_ = std::make_shared<const TestMatrix>(std::move(matrix));
+    }
+
+    // Others build their matrix from scratch when asked.
+    explicit Strategy(int t, GuaranteedBest gb, BelongsInFile bf, std::function<TestMatrixPtr()> make_tests) :
+        t(t), guaranteed_best(gb), belongs_in_file(bf), make_tests_(std::move(make_tests))
     {
-        tests = [vec = std::move(testvec)]() { return vec; };
     }
 
-    explicit Strategy(int t, GuaranteedBest gb, BelongsInFile bf, std::function<std::vector<std::string>()> tests) :
-        t(t), guaranteed_best(gb), belongs_in_file(bf), tests(std::move(tests))
+    // "animal" is the one dropped, for DropSheep and DropWolf.
+    explicit Strategy(Derivation how, std::shared_ptr<const Strategy> parent, int t, int animal = -1) :
+        t(t), guaranteed_best(GuaranteedBest::No), belongs_in_file(BelongsInFile::No),
+        derivation_(how), parent_(std::move(parent)), animal_(animal)
     {
+        assert(derivation_ != Derivation::None && parent_ != nullptr);
+    }
+
+    // A strategy that's asked for its tests a second time keeps them.
+    TestMatrixPtr tests() const;
+
+    // How many tests each animal is in. Most derived strategies can work
+    // this out from the strategy they came from, without building their
+    // tests; the rest build them and count. Either way it's worked out once.
+    const std::vector<int>& column_counts() const {
+        if (column_counts_ == nullptr) {
+            std::vector<int> counts;
+            if (derivation_ == Derivation::TestLastAnimal) {
+                counts = parent_->column_counts();
+                counts.push_back(1);
+            } else if (derivation_ == Derivation::DropSheep) {
+                counts = parent_->column_counts();
+                counts.erase(counts.begin() + animal_);
+            } else if (derivation_ == Derivation::Same) {
+                counts = parent_->column_counts();
+            } else {
+                TestMatrixPtr m = tests();
+                for (int i = 0; i < m->num_animals(); ++i) {
+                    counts.push_back(m->column_count(i));
+                }
+            }
+            column_counts_ = std::make_shared<const std::vector<int>>(std::move(counts));
+        }
+        return *column_counts_;
     }
 
     bool isBetterThan(const Strategy& rhs) const {
@@ -43,9 +103,9 @@ struct Strategy {
         std::ostringstream oss;
         oss << "N=" << n << " D=" << d << " T=" << t;
         oss << " guaranteed_best=" << ((guaranteed_best == GuaranteedBest::Yes) ? '1' : '0') << '\n';
-        auto concrete_tests = tests();
-        for (auto&& test : concrete_tests) {
-            oss << test << '\n';
+        TestMatrixPtr m = tests();
+        for (int r = 0; r < t; ++r) {
+            oss << m->row_string(r) << '\n';
         }
         return std::move(oss).str();
     }
@@ -63,12 +123,11 @@ struct Strategy {
         oss << " guaranteed_best=" << ((guaranteed_best == GuaranteedBest::Yes) ? '1' : '0') << '\n';
         oss << "emathgroup";
         int wordwrap = 10;
-        auto concrete_tests = tests();
+        TestMatrixPtr m = tests();
+        assert(t <= 64);
         for (int c=0; c < n; ++c) {
-            unsigned long long bits = 0;
-            for (int r = t-1; r >= 0; --r) {
-                bits = ((bits << 1) | (concrete_tests[r][c] == '1'));
-            }
+            // Bit r of the column is test r, just as emathgroup wants it.
+            unsigned long long bits = (t == 0) ? 0 : m->column(c)[0];
             std::string hexbits = to_hex(bits);
             if (wordwrap + 1 + hexbits.size() > 75) {
                 oss << "\n" << hexbits;
@@ -82,20 +141,98 @@ struct Strategy {
         return std::move(oss).str();
     }
 
+private:
+    Derivation derivation_ = Derivation::None;
+    std::shared_ptr<const Strategy> parent_;
+    int animal_ = -1;
+    std::function<TestMatrixPtr()> make_tests_;
+    mutable TestMatrixPtr memo_;
+    mutable int times_asked_ = 0;
+    mutable std::shared_ptr<const std::vector<int>> column_counts_;
 };
 
-std::shared_ptr<Strategy> empty_strategy()
+TestMatrixPtr Strategy::tests() const
 {
-    return std::make_shared<Strategy>(std::vector<std::string>{}, GuaranteedBest::Yes, BelongsInFile::No);
+    if (memo_ != nullptr) {
+        return memo_;
+    }
+
+    // The derivations between us and the nearest strategy with its tests to hand.
+    std::vector<const Strategy *> chain;
+    const Strategy *base = this;
+    while (base->derivation_ != Derivation::None && base->memo_ == nullptr) {
+        chain.push_back(base);
+        base = base->parent_.get();
+    }
+    TestMatrixPtr base_tests = (base->memo_ != nullptr) ? base->memo_ : base->make_tests_();
+
+    TestMatrixPtr result;
+    if (chain.empty()) {
+        result = std::move(base_tests);
+    } else {
+        // Replay the derivations, oldest first, keeping track only of which
+        // animals and which tests survive. An animal is a column of base_tests,
+        // or one added since, numbered from base_n up; a test is a row of
+        // base_tests, or (-1, a) for the test of added animal a alone.
+        const int base_n = base_tests->num_animals();
+        int next_animal = base_n;
+        std::vector<int> animals(base_n);
+        for (int i = 0; i < base_n; ++i) animals[i] = i;
+        std::vector<std::pair<int, int>> rows;
+        for (int r = 0; r < base_tests->num_tests(); ++r) rows.emplace_back(r, -1);
+
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            const Strategy& s = **it;
+            if (s.derivation_ == Derivation::TestLastAnimal) {
+                animals.push_back(next_animal);
+                rows.emplace_back(-1, next_animal);
+                ++next_animal;
+            } else if (s.derivation_ == Derivation::DropSheep || s.derivation_ == Derivation::DropWolf) {
+                const int a = animals[s.animal_];
+                animals.erase(animals.begin() + s.animal_);
+                if (s.derivation_ == Derivation::DropWolf) {
+                    rows.erase(std::remove_if(rows.begin(), rows.end(), [&](const std::pair<int, int>& row) {
+                        return (row.first >= 0) ? (a < base_n && base_tests->test_contains_animal(row.first, a)) : (row.second == a);
+                    }), rows.end());
+                }
+            }
+        }
+        assert(int(rows.size()) == t);
+
+        std::vector<int> column_of(next_animal, -1);
+        for (int j = 0; j < int(animals.size()); ++j) column_of[animals[j]] = j;
+        auto tests = std::make_shared<TestMatrix>(t, animals.size());
+        for (int r = 0; r < t; ++r) {
+            if (rows[r].first >= 0) {
+                base_tests->for_each_animal_in(rows[r].first, [&](int a) {
+                    if (column_of[a] >= 0) tests->set(r, column_of[a], true);
+                });
+            } else if (column_of[rows[r].second] >= 0) {
+                tests->set(r, column_of[rows[r].second], true);
+            }
+        }
+        result = std::move(tests);
+    }
+
+    if (++times_asked_ >= 2) {
+        memo_ = result;
+    }
+    return result;
+}
+
+std::shared_ptr<Strategy> empty_strategy(int n)
+{
+    return std::make_shared<Strategy>(TestMatrix(0, n), GuaranteedBest::Yes, BelongsInFile::No);
 }
 
 std::shared_ptr<Strategy> perfect_strategy_for_one_wolf(int n)
 {
-    std::vector<std::string> tests;
-    for (int bit = 1; bit < n; bit <<= 1) {
-        tests.push_back(std::string(n, '.'));
+    int t = 0;
+    while ((1 << t) < n) ++t;
+    TestMatrix tests(t, n);
+    for (int r = 0; r < t; ++r) {
         for (int i=0; i < n; ++i) {
-            tests.back()[i] = ((i & bit) ? '1' : '.');
+            tests.set(r, i, (i >> r) & 1);
         }
     }
     return std::make_shared<Strategy>(std::move(tests), GuaranteedBest::Yes, BelongsInFile::No);
@@ -108,71 +245,32 @@ std::shared_ptr<Strategy> worst_case_strategy(int n, GuaranteedBest gb)
         gb,
         BelongsInFile::No,
         [n]() {
-            std::vector<std::string> tests;
+            auto tests = std::make_shared<TestMatrix>(n-1, n);
             for (int i=0; i < n-1; ++i) {
-                tests.push_back(std::string(n, '.'));
-                tests.back()[i] = '1';
+                tests->set(i, i, true);
             }
-            return tests;
+            return TestMatrixPtr(std::move(tests));
         }
     );
 }
 
-std::shared_ptr<Strategy> test_last_animal_individually(int n, std::shared_ptr<Strategy> orig)
+std::shared_ptr<Strategy> test_last_animal_individually(std::shared_ptr<Strategy> orig)
 {
-    return std::make_shared<Strategy>(
-        orig->t + 1,
-        GuaranteedBest::No,
-        BelongsInFile::No,
-        [orig, n]() {
-            auto tests = orig->tests();
-            for (auto& test : tests) {
-                test.push_back('.');
-            }
-            tests.push_back(std::string(n, '.') + '1');
-            return tests;
-        }
-    );
+    return std::make_shared<Strategy>(Derivation::TestLastAnimal, orig, orig->t + 1);
 }
 
 std::shared_ptr<Strategy> replace_most_tested_animal(std::shared_ptr<Strategy> orig, bool with_wolf)
 {
-    auto tests = orig->tests();
-    const int n = tests[0].size();
-
-    std::vector<int> counts(n);
-    for (auto&& test : tests) {
-        for (int i=0; i < n; ++i) {
-            counts[i] += (test[i] == '1');
-        }
-    }
-    auto most_tested_idx = std::max_element(counts.begin(), counts.end()) - counts.begin();
-    int most_tested_count = counts[most_tested_idx];
+    const std::vector<int>& counts = orig->column_counts();
+    const int most_tested_idx = std::max_element(counts.begin(), counts.end()) - counts.begin();
+    const int most_tested_count = counts[most_tested_idx];
     assert(most_tested_count >= 2);
 
     if (with_wolf) {
-        tests.erase(
-            std::remove_if(
-                tests.begin(),
-                tests.end(),
-                [&](const auto& test){ return test[most_tested_idx] == '1'; }
-            ),
-            tests.end()
-        );
+        return std::make_shared<Strategy>(Derivation::DropWolf, orig, orig->t - most_tested_count, most_tested_idx);
+    } else {
+        return std::make_shared<Strategy>(Derivation::DropSheep, orig, orig->t, most_tested_idx);
     }
-
-    return std::make_shared<Strategy>(
-        tests.size(),
-        GuaranteedBest::No,
-        BelongsInFile::No,
-        [most_tested_idx, captured_tests = std::move(tests)]() {
-            auto tests = captured_tests;
-            for (auto&& test : tests) {
-                test.erase(test.begin() + most_tested_idx);
-            }
-            return tests;
-        }
-    );
 }
 
 
@@ -181,33 +279,91 @@ struct ND {
     bool operator<(const ND& rhs) const { return std::tie(d, n) < std::tie(rhs.d, rhs.n); }
 };
 
-bool overwrite_if_better(std::map<ND, std::shared_ptr<Strategy>>& m, int n, int d, std::shared_ptr<Strategy> strategy)
+std::shared_ptr<Strategy> easy_strategy(int n, int d)
 {
-    assert(0 <= n);
-    assert(0 <= d && d <= n);
-    auto it = m.find(ND{n,d});
-    if (it == m.end()) {
-        return false;
-    } else if (strategy->isBetterThan(*it->second)) {
-        if (it->second->guaranteed_best != GuaranteedBest::No) {
-            printf("Replacing t(%d,%d)<=%d with t(%d,%d)<=%d\n", n,d,it->second->t,n,d,strategy->t);
+    return
+        (d == 0 || d == n) ? empty_strategy(n) :
+        (d == 1) ? perfect_strategy_for_one_wolf(n) :
+        (d >= n/2) ? worst_case_strategy(n, GuaranteedBest::Yes) :
+        worst_case_strategy(n, GuaranteedBest::No);
+}
+
+// The best strategy we know for each (n,d) with n <= max_n. A cell is empty
+// until it's first looked at, when it gets the easy solution for (n,d); so
+// we only ever build the cells that something was derived into, or that
+// somebody asked about.
+struct SolutionTable {
+    explicit SolutionTable(int max_n) : max_n_(max_n) {}
+
+    bool contains(int n, int d) const { return 0 <= d && d <= n && n <= max_n_; }
+
+    std::shared_ptr<Strategy>& at(int n, int d) {
+        assert(contains(n, d));
+        if (int(cells_.size()) <= d) {
+            cells_.resize(d + 1);
+        }
+        std::vector<std::shared_ptr<Strategy>>& row = cells_[d];
+        if (int(row.size()) <= n) {
+            row.resize(n + 1);
+        }
+        if (row[n] == nullptr) {
+            row[n] = easy_strategy(n, d);
+        }
+        return row[n];
+    }
+
+    // Call f(nd, strategy) for each cell that's been looked at, in order of d and then n.
+    template<class F>
+    void for_each(const F& f) const {
+        for (int d = 0; d < int(cells_.size()); ++d) {
+            for (int n = d; n < int(cells_[d].size()); ++n) {
+                if (cells_[d][n] != nullptr) {
+                    f(ND{n, d}, cells_[d][n]);
+                }
+            }
         }
-        assert((it->second->guaranteed_best == GuaranteedBest::No) || !"found something better than the guaranteed best");
-        if (it->second->belongs_in_file == BelongsInFile::Yes) {
+    }
+
+private:
+    int max_n_;
+    std::vector<std::vector<std::shared_ptr<Strategy>>> cells_;  // indexed by d, then n
+};
+
+bool overwrite_if_better(std::shared_ptr<Strategy>& current, int n, int d, std::shared_ptr<Strategy> strategy)
+{
+    if (strategy->isBetterThan(*current)) {
+        if (current->guaranteed_best != GuaranteedBest::No) {
+            printf("Replacing t(%d,%d)<=%d with t(%d,%d)<=%d\n", n,d,current->t,n,d,strategy->t);
+        }
+        assert((current->guaranteed_best == GuaranteedBest::No) || !"found something better than the guaranteed best");
+        if (current->belongs_in_file == BelongsInFile::Yes) {
             // If this solution came from the file, we don't want to completely vanish it.
             // Replace it in the file with this better solution.
             strategy->belongs_in_file = BelongsInFile::Yes;
         }
-        it->second = strategy;
+        current = std::move(strategy);
         return true;
     }
     return false;
 }
 
+bool overwrite_if_better(SolutionTable& m, int n, int d, std::shared_ptr<Strategy> strategy)
+{
+    assert(0 <= n);
+    assert(0 <= d && d <= n);
+    return m.contains(n, d) && overwrite_if_better(m.at(n, d), n, d, std::move(strategy));
+}
+
 void preserve_from_file(std::map<ND, std::shared_ptr<Strategy>>& m, int n, int d, std::shared_ptr<Strategy> strategy)
 {
-    m.insert(std::make_pair(ND{n,d}, worst_case_strategy(n, GuaranteedBest::No)));
-    bool overwritten = overwrite_if_better(m, n, d, strategy);
+    auto it = m.insert(std::make_pair(ND{n,d}, worst_case_strategy(n, GuaranteedBest::No))).first;
+    bool overwritten = overwrite_if_better(it->second, n, d, std::move(strategy));
+    assert(overwritten);
+}
+
+void preserve_from_file(SolutionTable& m, int n, int d, std::shared_ptr<Strategy> strategy)
+{
+    bool overwritten = overwrite_if_better(m, n, d, std::move(strategy));
     assert(overwritten);
 }
 
@@ -217,50 +373,13 @@ void read_solutions_from_file(const char *filename, std::map<ND, std::shared_ptr
     if (!infile.is_open()) {
         throw std::runtime_error("Failed to open solution file");
     }
-    std::string line;
-    bool seen_a_grid = false;
-    while (std::getline(infile, line)) {
-        if (line.compare(0, 2, "N=") == 0) {
-            int n, d, t, gb;
-            std::vector<std::string> tests;
-            int rc = std::sscanf(line.c_str(), "N=%d D=%d T=%d guaranteed_best=%d", &n, &d, &t, &gb);
-            assert(rc == 4 || !"input file contained malformed lines");
-            char nextch = infile.get();
-            infile.putback(nextch);
-            if (nextch == 'e') {
-                std::string word;
-                infile >> word;
-                assert(word == "emathgroup");
-                // This format comes from Zhao Hui Du, https://emathgroup.github.io/blog/two-poisoned-wine
-                tests.resize(t);
-                for (int i=0; i < n; ++i) {
-                    infile >> word;
-                    unsigned long long bits;
-                    rc = std::sscanf(word.c_str(), "%llx", &bits);
-                    assert(rc == 1 || !"emathgroup format contained malformed lines");
-                    assert(0 <= bits && bits < (1uLL << t));
-                    for (int r = 0; r < t; ++r) {
-                        tests[r].push_back((bits & 1) ? '1' : '.');
-                        bits >>= 1;
-                    }
-                }
-            } else {
-                for (int r=0; r < t; ++r) {
-                    std::getline(infile, line);
-                    assert(line.size() == n || !"input file contained malformed solution");
-                    tests.push_back(line);
-                }
-            }
-            auto strategy = std::make_shared<Strategy>(tests, gb ? GuaranteedBest::Yes : GuaranteedBest::No, BelongsInFile::Yes);
-            preserve_from_file(m, n, d, std::move(strategy));
-            seen_a_grid = true;
-        } else if (seen_a_grid && line != "") {
-            assert(!"input file contained malformed lines after the first grid");
-        }
-    }
+    read_solution_records(infile, [&](SolutionRecord&& r) {
+        auto strategy = std::make_shared<Strategy>(std::move(r.tests), r.guaranteed_best ? GuaranteedBest::Yes : GuaranteedBest::No, BelongsInFile::Yes);
+        preserve_from_file(m, r.n, r.d, std::move(strategy));
+    });
 }
 
-void write_solutions_to_file(const char *filename, const std::map<ND, std::shared_ptr<Strategy>>& m)
+void write_solutions_to_file(const char *filename, SolutionTable& m)
 {
     std::ofstream outfile(filename);
 
@@ -276,9 +395,8 @@ void write_solutions_to_file(const char *filename, const std::map<ND, std::share
     for (int n = 4; n <= max_n_to_print; ++n) {
         outfile << "    n=" << std::setw(2) << std::left << n << "   ";
         for (int d = 1; d < n; ++d) {
-            auto it = m.find(ND{n,d});
-            if (it != m.end()) {
-                int value = it->second->t;
+            if (m.contains(n, d)) {
+                int value = m.at(n, d)->t;
                 outfile << ' ' << std::setw(2) << std::right << value;
                 if (value == n-1) {
                     // Don't bother filling out the rest of this line.
@@ -292,101 +410,306 @@ void write_solutions_to_file(const char *filename, const std::map<ND, std::share
     }
     outfile << "\n\n";
 
-    for (const auto& kv : m) {
-        int n = kv.first.n;
-        int d = kv.first.d;
-        const auto& strategy = kv.second;
+    m.for_each([&](ND nd, const std::shared_ptr<Strategy>& strategy) {
         if (strategy->belongs_in_file == BelongsInFile::Yes) {
-            if (n > 150) {
-                outfile << strategy->to_emathgroup_string(n, d) << '\n';
+            if (nd.n > 150) {
+                outfile << strategy->to_emathgroup_string(nd.n, nd.d) << '\n';
             } else {
-                outfile << strategy->to_string(n, d) << '\n';
+                outfile << strategy->to_string(nd.n, nd.d) << '\n';
             }
         }
+    });
+}
+
+// The store's matrices stay on disk until a strategy derived from them is asked for its tests.
+void read_solutions_from_store(const char *filename, std::map<ND, std::shared_ptr<Strategy>>& m)
+{
+    auto store = std::make_shared<const SolutionStore>(filename);
+    for (int i = 0; i < store->size(); ++i) {
+        SolutionStore::Entry e = store->entry(i);
+        auto strategy = std::make_shared<Strategy>(
+            e.t,
+            e.guaranteed_best ? GuaranteedBest::Yes : GuaranteedBest::No,
+            BelongsInFile::Yes,
+            [store, i]() { return std::make_shared<const TestMatrix>(store->tests(i)); }
+        );
+        preserve_from_file(m, e.n, e.d, std::move(strategy));
     }
 }
 
-void add_easy_solutions(std::map<ND, std::shared_ptr<Strategy>>& m, int max_n)
+void write_solutions_to_store(const char *filename, const SolutionTable& m)
 {
-    for (int n=0; n <= max_n; ++n) {
-        for (int d=0; d <= n; ++d) {
-            auto strategy =
-                (d == 0 || d == n) ? empty_strategy() :
-                (d == 1) ? perfect_strategy_for_one_wolf(n) :
-                (d >= n/2) ? worst_case_strategy(n, GuaranteedBest::Yes) :
-                worst_case_strategy(n, GuaranteedBest::No);
-            m.insert(std::make_pair(ND{n,d}, strategy));
+    std::vector<std::pair<SolutionStore::Entry, TestMatrixPtr>> records;
+    m.for_each([&](ND nd, const std::shared_ptr<Strategy>& strategy) {
+        if (strategy->belongs_in_file == BelongsInFile::Yes) {
+            SolutionStore::Entry e = { nd.n, nd.d, strategy->t, strategy->guaranteed_best == GuaranteedBest::Yes };
+            records.emplace_back(e, strategy->tests());
         }
+    });
+    if (!SolutionStore::save(filename, std::move(records))) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Cells whose strategy has improved, and so might improve their neighbours,
+// taken first-come first-served: that way a cell's direct derivations reach
+// their neighbours before the roundabout ones do, and few cells improve twice.
+// If a cell improves again before its turn comes, the stale entry is skipped.
+using Worklist = std::deque<std::pair<ND, std::shared_ptr<Strategy>>>;
+
+void offer_strategy(SolutionTable& m, Worklist& worklist, int n, int d, std::shared_ptr<Strategy> strategy)
+{
+    if (overwrite_if_better(m, n, d, strategy)) {
+        worklist.emplace_back(ND{n, d}, std::move(strategy));
     }
 }
 
-template<class KeyValue>
-void add_solutions_derived_from(std::map<ND, std::shared_ptr<Strategy>>& m, const KeyValue& kv)
+void add_solutions_derived_from(SolutionTable& m, Worklist& worklist, ND nd, const std::shared_ptr<Strategy>& strategy)
 {
-    int n = kv.first.n;
-    int d = kv.first.d;
-    const std::shared_ptr<Strategy>& strategy = kv.second;
+    int n = nd.n;
+    int d = nd.d;
     int t = strategy->t;
 
     if (2 <= d && d < n && t < n-1) {
         // A solution to t(n-k,d) can be constructed from t(n,d): simply introduce k innocent sheep.
         // It's only worth doing if t < n-1.
-        auto smaller_strategy = replace_most_tested_animal(strategy, false);
-        if (overwrite_if_better(m, n-1, d, smaller_strategy)) {
-            add_solutions_derived_from(m, *m.find(ND{n-1, d}));
-        }
+        offer_strategy(m, worklist, n-1, d, replace_most_tested_animal(strategy, false));
         if (d-1 >= 2) {
-            auto smaller_strategy = replace_most_tested_animal(strategy, true);
-            if (overwrite_if_better(m, n-1, d-1, smaller_strategy)) {
-                add_solutions_derived_from(m, *m.find(ND{n-1, d-1}));
-            }
+            offer_strategy(m, worklist, n-1, d-1, replace_most_tested_animal(strategy, true));
         }
     }
     if (2 < d && d < n-1 && t < n-1) {
         // A solution for (n,d) also works for (n,d-1) except when d >= n-1.
-        std::shared_ptr<Strategy> r = std::make_shared<Strategy>(
-            strategy->t,
-            GuaranteedBest::No,
-            BelongsInFile::No,
-            [strategy]() { return strategy->tests(); }
-        );
-        if (overwrite_if_better(m, n, d-1, r)) {
-            add_solutions_derived_from(m, *m.find(ND{n, d-1}));
-        }
+        offer_strategy(m, worklist, n, d-1, std::make_shared<Strategy>(Derivation::Same, strategy, strategy->t));
     }
     if (2 <= d && d < n && t < n-1) {
-        if (overwrite_if_better(m, n+1, d, test_last_animal_individually(n, strategy))) {
-            add_solutions_derived_from(m, *m.find(ND{n+1, d}));
-        }
+        offer_strategy(m, worklist, n+1, d, test_last_animal_individually(strategy));
     }
     if (strategy->t == n-1) {
-        if (overwrite_if_better(m, n+2, d+1, worst_case_strategy(n+2, strategy->guaranteed_best))) {
-            add_solutions_derived_from(m, *m.find(ND{n+2, d+1}));
+        offer_strategy(m, worklist, n+2, d+1, worst_case_strategy(n+2, strategy->guaranteed_best));
+    }
+}
+
+// Apply the transforms above until nothing in the table improves any more.
+void derive_solutions(SolutionTable& m, Worklist worklist)
+{
+    while (!worklist.empty()) {
+        ND nd = worklist.front().first;
+        std::shared_ptr<Strategy> strategy = std::move(worklist.front().second);
+        worklist.pop_front();
+        if (m.at(nd.n, nd.d) == strategy) {
+            add_solutions_derived_from(m, worklist, nd, strategy);
+        }
+    }
+}
+
+// Verify, having first looked at about sample_size arrangements at random (if
+// it isn't zero), so that most bad strategies are turned down in milliseconds
+// rather than after the whole exhaustive check.
+static VerifyStrategyResult verify_after_sampling(const TestMatrix& tests, int d, unsigned long long sample_size,
+                                                  VerifyMethod method, int num_threads)
+{
+    if (sample_size != 0) {
+        VerifyStrategyResult r = sample_strategy(tests, d, sample_size);
+        if (!r.success) {
+            return r;
         }
     }
+    return verify_strategy(tests, d, method, num_threads);
+}
+
+// Roughly how many wolf arrangements verify_strategy will have to look at.
+static double approx_arrangements(int n, int d)
+{
+    double result = 1;
+    for (int i = 0; i < d; ++i) {
+        result = result * (n - i) / (i + 1);
+    }
+    return result;
+}
+
+// Verify every strategy from the file, and say which (if any) are invalid.
+// The big ones get all the threads, one strategy at a time; the rest
+// are shared out among the threads, one strategy per thread at a time.
+static void verify_all_solutions(const std::map<ND, std::shared_ptr<Strategy>>& solutions,
+                                 unsigned long long sample_size, VerifyMethod method, int num_threads)
+{
+    std::vector<std::pair<ND, std::shared_ptr<Strategy>>> all(solutions.begin(), solutions.end());
+    std::vector<VerifyStrategyResult> results(all.size());
+    std::vector<size_t> small;
+    for (size_t j = 0; j < all.size(); ++j) {
+        if (approx_arrangements(all[j].first.n, all[j].first.d) >= 1e6) {
+            results[j] = verify_after_sampling(*all[j].second->tests(), all[j].first.d, sample_size, method, num_threads);
+        } else {
+            small.push_back(j);
+        }
+    }
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back([&]() {
+            for (size_t s; (s = next++) < small.size(); ) {
+                size_t j = small[s];
+                results[j] = verify_after_sampling(*all[j].second->tests(), all[j].first.d, sample_size, method, 1);
+            }
+        });
+    }
+    for (auto&& th : threads) th.join();
+
+    for (size_t j = 0; j < all.size(); ++j) {
+        if (!results[j].success) {
+            printf("INVALID! (This should never happen unless the solution file is bad.)\n");
+            printf("%s\n", all[j].second->to_string(all[j].first.n, all[j].first.d).c_str());
+            printf("These two wolf arrangements cannot be distinguished:\n");
+            printf("%s\n", results[j].w1.c_str());
+            printf("%s\n", results[j].w2.c_str());
+        }
+    }
+}
+
+// The matrix with its test of the fewest animals taken out.
+static TestMatrix without_lightest_test(const TestMatrix& tests)
+{
+    int lightest = 0;
+    std::vector<int> sizes(tests.num_tests());
+    for (int r = 0; r < tests.num_tests(); ++r) {
+        tests.for_each_animal_in(r, [&](int) { sizes[r] += 1; });
+        if (sizes[r] < sizes[lightest]) lightest = r;
+    }
+    TestMatrix result(tests.num_tests() - 1, tests.num_animals());
+    for (int r = 0, out = 0; r < tests.num_tests(); ++r) {
+        if (r != lightest) {
+            tests.for_each_animal_in(r, [&](int a) { result.set(out, a, true); });
+            out += 1;
+        }
+    }
+    return result;
+}
+
+// Try to beat the best strategy we know for (n,d), one test at a time, by
+// annealing it with a test taken out, for up to max_flips moves in all. What
+// we know for (n,d) includes whatever derive_solutions brought over from its
+// neighbours, so that's where the search starts. Each success is verified
+// and then derived from like any other strategy from the file.
+static void improve_by_annealing(SolutionTable& m, const BoundsDB& db, int n, int d,
+                                 unsigned long long max_flips, uint64_t seed,
+                                 unsigned long long sample_size, VerifyMethod method, int num_threads)
+{
+    while (max_flips != 0) {
+        std::shared_ptr<Strategy> current = m.at(n, d);
+        if (current->guaranteed_best == GuaranteedBest::Yes || current->t <= db.lower_bound(n, d)) {
+            printf("t(%d,%d)=%d is already known to be the best possible.\n", n, d, current->t);
+            return;
+        }
+        if (current->t - 1 > 64) {
+            printf("Annealing handles at most 64 tests; t(%d,%d)<=%d is too many.\n", n, d, current->t);
+            return;
+        }
+        TestMatrix tests = without_lightest_test(*current->tests());
+        AnnealOptions options;
+        options.max_flips = max_flips;
+        options.seed = seed++;
+        AnnealResult r = anneal_to_separable(&tests, d, options);
+        max_flips -= r.flips;
+        if (!r.success) {
+            printf("Annealing found nothing for t(%d,%d)<=%d in %llu moves; the best left %llu pairs of arrangements colliding.\n",
+                   n, d, tests.num_tests(), r.flips, r.collisions);
+            return;
+        }
+        VerifyStrategyResult v = verify_after_sampling(tests, d, sample_size, method, num_threads);
+        if (!v.success) {
+            printf("INVALID! (This should never happen unless annealing is broken.)\n");
+            printf("These two wolf arrangements cannot be distinguished:\n");
+            printf("%s\n", v.w1.c_str());
+            printf("%s\n", v.w2.c_str());
+            exit(EXIT_FAILURE);
+        }
+        printf("Annealing found t(%d,%d)<=%d in %llu moves.\n", n, d, tests.num_tests(), r.flips);
+        Worklist worklist;
+        offer_strategy(m, worklist, n, d, std::make_shared<Strategy>(std::move(tests), GuaranteedBest::No, BelongsInFile::Yes));
+        derive_solutions(m, std::move(worklist));
+    }
 }
 
 int main(int argc, char **argv)
 {
     const char *filename = "wolfy-out.txt";
+    const char *store_filename = nullptr;
+    const char *save_store_filename = nullptr;
+    const char *save_text_filename = nullptr;
+    const char *bounds_filename = BoundsDB::default_filename;
     bool verify = false;
     bool verify_all = false;
+    unsigned long long anneal_flips = 0;
+    uint64_t anneal_seed = 0;
+    unsigned long long sample_size = 0;
+    VerifyMethod verify_method = VerifyMethod::SortedArray;
+    int num_threads = std::max(1u, std::thread::hardware_concurrency());
     int i = 1;
     for (; argv[i] != nullptr && argv[i][0] == '-'; ++i) {
         if (strcmp(argv[i], "--help") == 0) {
-            puts("./wolfy [--file f.txt] [--verify] N D");
+            puts("./wolfy [--file f.txt | --store s.bin] [--save-store s.bin] [--save-text f.txt]");
+            puts("        [--bounds b.txt] [--verify] [--verify-with sort|hash|gpu] [--threads N]");
+            puts("        [--sample K] [--anneal MOVES] [--seed S] N D");
             puts("");
             puts("Print the smallest known D-separable matrix with N columns.");
             puts("  --file f.txt    Read best known solutions from this file");
+            puts("  --store s.bin   Read them from this binary store instead, and write any");
+            puts("                  improvements back to it rather than to wolfy-out.txt");
+            puts("  --save-store s.bin  Also write the best known solutions to this binary store");
+            puts("  --save-text f.txt   Also write them to this file in the text format");
+            puts("  --bounds b.txt  Read lower bounds proven by st and mt from this file");
             puts("  --verify        Verbosely verify the solution that is printed");
             puts("  --verify-all    Verify every solution in the input file");
+            puts("  --verify-with sort|hash|gpu  Find duplicate results by sorting them all in one");
+            puts("                  array (default), with a hash table, or by sorting them on");
+            puts("                  the GPU (make CUDA=1)");
+            puts("  --threads N     Verify on this many threads (default: one per core)");
+            puts("  --sample K      Before verifying anything in full, look for a collision among about");
+            puts("                  K random arrangements and their one-wolf-swapped neighbours, which");
+            puts("                  turns down most bad strategies at once (a few million is plenty)");
+            puts("  --anneal MOVES  First try to beat the best known strategy for (N,D) by simulated");
+            puts("                  annealing with one test fewer, for up to MOVES moves in all;");
+            puts("                  whatever it finds is verified and saved like any other improvement");
+            puts("  --seed S        Seed the annealing with S (default 0)");
             exit(0);
         } else if (strcmp(argv[i], "--file") == 0) {
             filename = argv[++i];
+        } else if (strcmp(argv[i], "--store") == 0 && argv[i+1] != nullptr) {
+            store_filename = argv[++i];
+        } else if (strcmp(argv[i], "--save-store") == 0 && argv[i+1] != nullptr) {
+            save_store_filename = argv[++i];
+        } else if (strcmp(argv[i], "--save-text") == 0 && argv[i+1] != nullptr) {
+            save_text_filename = argv[++i];
+        } else if (strcmp(argv[i], "--bounds") == 0) {
+            bounds_filename = argv[++i];
         } else if (strcmp(argv[i], "--verify") == 0) {
             verify = true;
         } else if (strcmp(argv[i], "--verify-all") == 0) {
             verify_all = true;
+        } else if (strcmp(argv[i], "--sample") == 0 && argv[i+1] != nullptr) {
+            sample_size = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--anneal") == 0 && argv[i+1] != nullptr) {
+            anneal_flips = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--seed") == 0 && argv[i+1] != nullptr) {
+            anneal_seed = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--threads") == 0 && argv[i+1] != nullptr) {
+            num_threads = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--verify-with") == 0 && argv[i+1] != nullptr) {
+            ++i;
+            if (strcmp(argv[i], "hash") == 0) {
+                verify_method = VerifyMethod::HashTable;
+            } else if (strcmp(argv[i], "sort") == 0) {
+                verify_method = VerifyMethod::SortedArray;
+            } else if (strcmp(argv[i], "gpu") == 0 && verifier_has_gpu()) {
+                verify_method = VerifyMethod::Gpu;
+            } else if (strcmp(argv[i], "gpu") == 0) {
+                printf("This ./wolfy was built without CUDA; rebuild it with \"make CUDA=1\".\n");
+                exit(EXIT_FAILURE);
+            } else {
+                printf("--verify-with must be 'sort', 'hash' or 'gpu'\n");
+                exit(EXIT_FAILURE);
+            }
         } else {
             printf("Unrecognized option '%s'; --help for help\n", argv[i]);
             exit(EXIT_FAILURE);
@@ -406,39 +729,76 @@ int main(int argc, char **argv)
     }
 
     std::map<ND, std::shared_ptr<Strategy>> solutions_from_file;
-    read_solutions_from_file(filename, solutions_from_file);
+    if (store_filename != nullptr) {
+        read_solutions_from_store(store_filename, solutions_from_file);
+    } else {
+        read_solutions_from_file(filename, solutions_from_file);
+    }
 
     if (verify_all) {
-        for (auto&& kv : solutions_from_file) {
-            VerifyStrategyResult r = verify_strategy(kv.first.n, kv.first.d, kv.second->tests());
-            if (!r.success) {
-                printf("INVALID! (This should never happen unless the solution file is bad.)\n");
-                printf("%s\n", kv.second->to_string(n, d).c_str());
-                printf("These two wolf arrangements cannot be distinguished:\n");
-                printf("%s\n", r.w1.c_str());
-                printf("%s\n", r.w2.c_str());
-            }
-        }
+        verify_all_solutions(solutions_from_file, sample_size, verify_method, num_threads);
     }
 
-    std::map<ND, std::shared_ptr<Strategy>> all_solutions;
-    add_easy_solutions(all_solutions, n + 100);
+    // Cells bigger than the query, the triangle and the file can only be
+    // reached by adding animals, and nothing derived back down from them beats
+    // the cells they came from; so the table stops there.
+    int max_n = std::max(n, 30);
+    for (auto&& kv : solutions_from_file) {
+        max_n = std::max(max_n, kv.first.n);
+    }
+    SolutionTable all_solutions(max_n);
+    Worklist worklist;
     for (auto&& kv : solutions_from_file) {
         preserve_from_file(all_solutions, kv.first.n, kv.first.d, kv.second);
-        add_solutions_derived_from(all_solutions, kv);
+        worklist.emplace_back(kv.first, kv.second);
     }
+    derive_solutions(all_solutions, std::move(worklist));
+    BoundsDB db(bounds_filename);
+    if (anneal_flips != 0 && 1 <= d && d < n) {
+        improve_by_annealing(all_solutions, db, n, d, anneal_flips, anneal_seed, sample_size, verify_method, num_threads);
+    }
+    std::shared_ptr<Strategy> strategy = all_solutions.at(n, d);
+
+    // The file needs rewriting only if one of its solutions was beaten,
+    // or has just been proven best.
+    bool file_changed = false;
+    all_solutions.for_each([&](ND nd, const std::shared_ptr<Strategy>& s) {
+        if (s->belongs_in_file == BelongsInFile::Yes) {
+            auto it = solutions_from_file.find(nd);
+            file_changed |= (it == solutions_from_file.end() || it->second != s);
+        }
+    });
 
-    write_solutions_to_file("wolfy-out.txt", all_solutions);
+    // If the solvers have proven that no strategy can do better, say so.
+    all_solutions.for_each([&](ND nd, const std::shared_ptr<Strategy>& s) {
+        if (db.lower_bound(nd.n, nd.d) >= s->t) {
+            file_changed |= (s->belongs_in_file == BelongsInFile::Yes && s->guaranteed_best == GuaranteedBest::No);
+            s->guaranteed_best = GuaranteedBest::Yes;
+        }
+    });
+
+    if (file_changed) {
+        if (store_filename != nullptr) {
+            write_solutions_to_store(store_filename, all_solutions);
+        } else {
+            write_solutions_to_file("wolfy-out.txt", all_solutions);
+        }
+    }
+    if (save_store_filename != nullptr) {
+        write_solutions_to_store(save_store_filename, all_solutions);
+    }
+    if (save_text_filename != nullptr) {
+        write_solutions_to_file(save_text_filename, all_solutions);
+    }
 
-    std::shared_ptr<Strategy> strategy = all_solutions.at(ND{n, d});
-    auto tests = strategy->tests();
+    TestMatrixPtr tests = strategy->tests();
 
     if (verify) {
         printf("Candidate is\n");
         printf("%s\n", strategy->to_string(n, d).c_str());
-        VerifyStrategyResult r = verify_strategy(n, d, tests);
+        VerifyStrategyResult r = verify_after_sampling(*tests, d, sample_size, verify_method, num_threads);
         if (r.success) {
-            printf("Verified. This is a solution for t(%d, %d) <= %zu.\n", n, d, tests.size());
+            printf("Verified. This is a solution for t(%d, %d) <= %d.\n", n, d, tests->num_tests());
         } else {
             printf("INVALID! (This should never happen unless the solution file is bad.)\n");
             printf("These two wolf arrangements cannot be distinguished:\n");
@@ -446,6 +806,6 @@ int main(int argc, char **argv)
             printf("%s\n", r.w2.c_str());
         }
     } else {
-        for (auto&& line : tests) printf("%s\n", line.c_str());
+        for (int r = 0; r < tests->num_tests(); ++r) printf("%s\n", tests->row_string(r).c_str());
     }
 }
@@ -0,0 +1,51 @@
+#include "solution_file.h"
+
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+void read_solution_records(std::istream& in, const std::function<void(SolutionRecord&&)>& f)
+{
+    std::string line;
+    bool seen_a_grid = false;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 2, "N=") == 0) {
+            int n, d, t, gb;
+            TestMatrix tests;
+            int rc = std::sscanf(line.c_str(), "N=%d D=%d T=%d guaranteed_best=%d", &n, &d, &t, &gb);
+            assert(rc == 4 || !"input file contained malformed lines");
+            char nextch = in.get();
+            in.putback(nextch);
+            if (nextch == 'e') {
+                std::string word;
+                in >> word;
+                assert(word == "emathgroup");
+                // This format comes from Zhao Hui Du, https://emathgroup.github.io/blog/two-poisoned-wine
+                tests = TestMatrix(t, n);
+                for (int i=0; i < n; ++i) {
+                    in >> word;
+                    unsigned long long bits;
+                    rc = std::sscanf(word.c_str(), "%llx", &bits);
+                    assert(rc == 1 || !"emathgroup format contained malformed lines");
+                    assert(0 <= bits && bits < (1uLL << t));
+                    for (int r = 0; r < t; ++r) {
+                        tests.set(r, i, (bits >> r) & 1);
+                    }
+                }
+            } else {
+                std::vector<std::string> rows;
+                for (int r=0; r < t; ++r) {
+                    std::getline(in, line);
+                    assert(line.size() == n || !"input file contained malformed solution");
+                    rows.push_back(line);
+                }
+                tests = TestMatrix::from_strings(rows, n);
+            }
+            f(SolutionRecord{n, d, t, gb != 0, std::move(tests)});
+            seen_a_grid = true;
+        } else if (seen_a_grid && line != "") {
+            assert(!"input file contained malformed lines after the first grid");
+        }
+    }
+}
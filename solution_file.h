@@ -0,0 +1,22 @@
+#pragma once
+
+#include <functional>
+#include <istream>
+#include "test_matrix.h"
+
+// One strategy from a solution file such as wolfy-out.txt: a line
+//
+//   N=11 D=2 T=8 guaranteed_best=1
+//
+// (anything after those four fields is ignored), followed by its T rows of N
+// '1's and '.'s, or else by the word "emathgroup" and N hexadecimal columns.
+struct SolutionRecord {
+    int n, d, t;
+    bool guaranteed_best;
+    TestMatrix tests;
+};
+
+// Calls f with each record in the file, in order. Anything before the first
+// record (such as wolfy's triangle) is skipped; after it, anything but records
+// and blank lines is an error.
+void read_solution_records(std::istream& in, const std::function<void(SolutionRecord&&)>& f);
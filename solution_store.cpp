@@ -0,0 +1,154 @@
+#include "solution_store.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <tuple>
+#include <unistd.h>
+
+static const char magic[8] = {'w','o','l','f','s','o','l','1'};
+
+struct Header {
+    char magic[8];
+    uint64_t num_records;
+};
+
+static size_t words_for(int bits)
+{
+    return (bits + 63) / 64;
+}
+
+static size_t record_bytes(int n, int t)
+{
+    return size_t(n) * words_for(t) * sizeof(uint64_t);
+}
+
+SolutionStore::SolutionStore(const std::string& filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error(filename + ": " + strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error(filename + ": " + strerror(errno));
+    }
+    size_ = st.st_size;
+    if (size_ < sizeof(Header)) {
+        close(fd);
+        throw std::runtime_error(filename + ": not a solution store");
+    }
+    void *p = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        throw std::runtime_error(filename + ": " + strerror(errno));
+    }
+    data_ = static_cast<const unsigned char *>(p);
+
+    const Header *header = reinterpret_cast<const Header *>(data_);
+    bool ok = (memcmp(header->magic, magic, sizeof magic) == 0) &&
+              (header->num_records <= (size_ - sizeof(Header)) / sizeof(IndexEntry));
+    if (ok) {
+        num_records_ = header->num_records;
+        index_ = reinterpret_cast<const IndexEntry *>(data_ + sizeof(Header));
+    }
+    for (int i = 0; ok && i < num_records_; ++i) {
+        const IndexEntry& e = index_[i];
+        ok = (0 <= e.d && e.d <= e.n && 0 <= e.t) &&
+             (e.offset % sizeof(uint64_t) == 0) &&
+             (e.offset <= size_) && (record_bytes(e.n, e.t) <= size_ - e.offset) &&
+             (i == 0 || std::tie(index_[i-1].n, index_[i-1].d) < std::tie(e.n, e.d));
+    }
+    if (!ok) {
+        munmap(const_cast<unsigned char *>(data_), size_);
+        throw std::runtime_error(filename + ": malformed solution store");
+    }
+}
+
+SolutionStore::~SolutionStore()
+{
+    munmap(const_cast<unsigned char *>(data_), size_);
+}
+
+SolutionStore::Entry SolutionStore::entry(int i) const
+{
+    assert(0 <= i && i < num_records_);
+    const IndexEntry& e = index_[i];
+    return Entry{e.n, e.d, e.t, e.guaranteed_best != 0};
+}
+
+int SolutionStore::find(int n, int d) const
+{
+    const IndexEntry *it = std::lower_bound(index_, index_ + num_records_, std::make_pair(n, d),
+        [](const IndexEntry& e, const std::pair<int, int>& nd) {
+            return std::tie(e.n, e.d) < std::tie(nd.first, nd.second);
+        });
+    if (it != index_ + num_records_ && it->n == n && it->d == d) {
+        return it - index_;
+    }
+    return -1;
+}
+
+TestMatrix SolutionStore::tests(int i) const
+{
+    assert(0 <= i && i < num_records_);
+    const IndexEntry& e = index_[i];
+    return TestMatrix::from_columns(reinterpret_cast<const uint64_t *>(data_ + e.offset), e.t, e.n);
+}
+
+static bool write_all(int fd, const void *data, size_t size)
+{
+    return write(fd, data, size) == ssize_t(size);
+}
+
+bool SolutionStore::save(const std::string& filename, std::vector<std::pair<Entry, TestMatrixPtr>> records)
+{
+    std::sort(records.begin(), records.end(), [](const auto& a, const auto& b) {
+        return std::tie(a.first.n, a.first.d) < std::tie(b.first.n, b.first.d);
+    });
+
+    Header header;
+    memcpy(header.magic, magic, sizeof magic);
+    header.num_records = records.size();
+    std::vector<IndexEntry> index;
+    uint64_t offset = sizeof(Header) + records.size() * sizeof(IndexEntry);
+    for (auto&& r : records) {
+        const Entry& e = r.first;
+        assert(r.second->num_tests() == e.t && r.second->num_animals() == e.n);
+        index.push_back(IndexEntry{e.n, e.d, e.t, e.guaranteed_best, offset});
+        offset += record_bytes(e.n, e.t);
+    }
+
+    std::string tmpname = filename + ".tmp";
+    int fd = open(tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", tmpname.c_str(), strerror(errno));
+        return false;
+    }
+    bool ok = write_all(fd, &header, sizeof header) &&
+              write_all(fd, index.data(), index.size() * sizeof(IndexEntry));
+    for (size_t i = 0; ok && i < records.size(); ++i) {
+        const TestMatrix& m = *records[i].second;
+        ok = write_all(fd, m.column(0), record_bytes(m.num_animals(), m.num_tests()));
+    }
+    ok = ok && (fsync(fd) == 0);
+    close(fd);
+    if (!ok) {
+        fprintf(stderr, "%s: short write\n", tmpname.c_str());
+        unlink(tmpname.c_str());
+        return false;
+    }
+    if (rename(tmpname.c_str(), filename.c_str()) != 0) {
+        fprintf(stderr, "%s: %s\n", filename.c_str(), strerror(errno));
+        unlink(tmpname.c_str());
+        return false;
+    }
+    return true;
+}
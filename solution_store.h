@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "test_matrix.h"
+
+// A binary copy of the solutions in wolfy-out.txt, laid out so that it can be
+// mmap'ed and a single (n,d) looked up without reading the rest:
+//
+//   Header   "wolfsol1", then the number of records
+//   Index    one IndexEntry per record, sorted by (n,d)
+//   Data     each record's matrix as n columns of words_for(t) words,
+//            exactly as TestMatrix::column() lays them out
+//
+// Everything is in the native byte order of the machine that wrote it, which
+// is to say little-endian. Like a checkpoint, it's written to a temporary
+// file, fsync'ed, and renamed over the old one. The text format stays the
+// way to read and edit solutions by hand; "wolfy --save-store" converts the
+// one to the other, and "wolfy --store s.bin --save-text f.txt" converts back.
+
+struct SolutionStore {
+    struct Entry {
+        int n, d, t;
+        bool guaranteed_best;
+    };
+
+    // Throws std::runtime_error if the file can't be opened or is malformed.
+    explicit SolutionStore(const std::string& filename);
+    ~SolutionStore();
+    SolutionStore(const SolutionStore&) = delete;
+    SolutionStore& operator=(const SolutionStore&) = delete;
+
+    int size() const { return num_records_; }
+    Entry entry(int i) const;
+
+    // The index of the record for (n,d), or -1 if there isn't one.
+    int find(int n, int d) const;
+
+    // Reads only the pages holding record i.
+    TestMatrix tests(int i) const;
+
+    // The matrices given must have n columns and t rows. Returns false (after
+    // saying why on stderr) if the file couldn't be written.
+    static bool save(const std::string& filename, std::vector<std::pair<Entry, TestMatrixPtr>> records);
+
+private:
+    struct IndexEntry {
+        int32_t n, d, t;
+        uint32_t guaranteed_best;
+        uint64_t offset;      // of the record's first word, from the start of the file
+    };
+
+    const unsigned char *data_ = nullptr;
+    size_t size_ = 0;
+    int num_records_ = 0;
+    const IndexEntry *index_ = nullptr;
+};
@@ -0,0 +1,90 @@
+#include "test_matrix.h"
+
+#include <algorithm>
+#include <assert.h>
+
+static int words_for(int bits)
+{
+    return (bits + 63) / 64;
+}
+
+TestMatrix::TestMatrix(int t, int n) :
+    t_(t), n_(n), row_words_(words_for(n)), col_words_(words_for(t)),
+    rows_(size_t(t) * row_words_), cols_(size_t(n) * col_words_)
+{
+    assert(t >= 0 && n >= 0);
+}
+
+TestMatrix TestMatrix::from_strings(const std::vector<std::string>& rows, int n)
+{
+    TestMatrix result(rows.size(), n);
+    for (int i = 0; i < result.t_; ++i) {
+        assert(rows[i].size() == size_t(n) || !"every test must mention every animal");
+        for (int j = 0; j < n; ++j) {
+            if (rows[i][j] == '1') {
+                result.set(i, j, true);
+            }
+        }
+    }
+    return result;
+}
+
+TestMatrix TestMatrix::from_columns(const uint64_t *words, int t, int n)
+{
+    TestMatrix result(t, n);
+    std::copy(words, words + result.cols_.size(), result.cols_.begin());
+    for (int j = 0; j < n; ++j) {
+        for (int w = 0; w < result.col_words_; ++w) {
+            for (uint64_t bits = result.column(j)[w]; bits != 0; bits &= bits - 1) {
+                int i = w * 64 + __builtin_ctzll(bits);
+                assert(i < t || !"column has bits set beyond the last test");
+                result.rows_[size_t(i) * result.row_words_ + j / 64] |= (uint64_t(1) << (j % 64));
+            }
+        }
+    }
+    return result;
+}
+
+void TestMatrix::set(int test, int animal, bool value)
+{
+    assert(0 <= test && test < t_);
+    assert(0 <= animal && animal < n_);
+    uint64_t& r = rows_[test * row_words_ + animal / 64];
+    uint64_t& c = cols_[animal * col_words_ + test / 64];
+    if (value) {
+        r |= (uint64_t(1) << (animal % 64));
+        c |= (uint64_t(1) << (test % 64));
+    } else {
+        r &= ~(uint64_t(1) << (animal % 64));
+        c &= ~(uint64_t(1) << (test % 64));
+    }
+}
+
+int TestMatrix::column_count(int animal) const
+{
+    int count = 0;
+    for (int w = 0; w < col_words_; ++w) {
+        count += __builtin_popcountll(column(animal)[w]);
+    }
+    return count;
+}
+
+std::string TestMatrix::row_string(int test) const
+{
+    std::string result(n_, '.');
+    for (int j = 0; j < n_; ++j) {
+        if (test_contains_animal(test, j)) {
+            result[j] = '1';
+        }
+    }
+    return result;
+}
+
+std::vector<std::string> TestMatrix::to_strings() const
+{
+    std::vector<std::string> result;
+    for (int i = 0; i < t_; ++i) {
+        result.push_back(row_string(i));
+    }
+    return result;
+}
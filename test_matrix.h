@@ -0,0 +1,65 @@
+#pragma once
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// A strategy's matrix of tests: row i is test i, column j is animal j, and
+// an entry is set if that test uses blood from that animal. The bits are
+// packed both ways round, as rows of n bits and as columns of t bits, so that
+// either view is a plain array of words: bit j of a row is bit (j % 64) of
+// word (j / 64), and likewise for the columns. Setting an entry updates both.
+// It's built once when a strategy is loaded or derived; strings of '1' and
+// '.' come back out only to be printed.
+
+struct TestMatrix {
+    TestMatrix() = default;
+    explicit TestMatrix(int t, int n);
+
+    // Each row is a string of n characters, '1' for each animal in the test.
+    static TestMatrix from_strings(const std::vector<std::string>& rows, int n);
+
+    // The columns are given as n runs of words_for(t) words each, laid out just
+    // as column() returns them.
+    static TestMatrix from_columns(const uint64_t *words, int t, int n);
+
+    int num_tests() const { return t_; }
+    int num_animals() const { return n_; }
+
+    bool test_contains_animal(int test, int animal) const {
+        return (rows_[test * row_words_ + animal / 64] >> (animal % 64)) & 1;
+    }
+    void set(int test, int animal, bool value);
+
+    int words_per_row() const { return row_words_; }
+    int words_per_column() const { return col_words_; }
+    const uint64_t *row(int test) const { return rows_.data() + test * row_words_; }
+    const uint64_t *column(int animal) const { return cols_.data() + animal * col_words_; }
+
+    // How many tests this animal is in.
+    int column_count(int animal) const;
+
+    // Call f(animal) for each animal in the test, in increasing order.
+    template<class F>
+    void for_each_animal_in(int test, const F& f) const {
+        for (int w = 0; w < row_words_; ++w) {
+            for (uint64_t bits = row(test)[w]; bits != 0; bits &= bits - 1) {
+                f(w * 64 + __builtin_ctzll(bits));
+            }
+        }
+    }
+
+    std::string row_string(int test) const;
+    std::vector<std::string> to_strings() const;
+
+private:
+    int t_ = 0;
+    int n_ = 0;
+    int row_words_ = 0;
+    int col_words_ = 0;
+    std::vector<uint64_t> rows_;
+    std::vector<uint64_t> cols_;
+};
+
+using TestMatrixPtr = std::shared_ptr<const TestMatrix>;
@@ -1,39 +1,114 @@
 
 #include "verify_strategy.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
-#include <limits>
-#include <map>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <string>
+#include <unordered_map>
+#include <thread>
 #include <vector>
 
+#include "combinatorics.h"
+
+#ifdef WOLVES_CUDA
+#include "verify_strategy_gpu.h"
+#endif
+
 using Int = unsigned long long;
 
+// Fibonacci hashing: the high bits of the product are well mixed even when
+// the input differs only in its low bits.
+static uint64_t mix(uint64_t x) { return x * 0x9E3779B97F4A7C15uLL; }
+
+// Each of these holds one bit per test, for up to 64, 128, 64*W, or any number
+// of tests; column bitmasks from TestMatrix drop straight into them. All but
+// TestResultsBig are plain values, so filling the array or hash table of C(n,d)
+// results never touches the heap.
+
 struct TestResults64 {
-    uint64_t data_;
-    void push_back(bool b) { data_ <<= 1; data_ |= uint64_t(b); }
+    uint64_t data_ = 0;
+    static TestResults64 from_words(const uint64_t *words, int num_words) { TestResults64 r; if (num_words) r.data_ = words[0]; return r; }
+    TestResults64& operator|=(const TestResults64& rhs) { data_ |= rhs.data_; return *this; }
+    uint64_t hash() const { return mix(data_); }
     friend bool operator<(const TestResults64& a, const TestResults64& b) { return a.data_ < b.data_; }
+    friend bool operator==(const TestResults64& a, const TestResults64& b) { return a.data_ == b.data_; }
 };
 
 struct TestResults128 {
-    unsigned __int128 data_;
-    void push_back(bool b) { data_ <<= 1; data_ |= (unsigned __int128)(b); }
+    unsigned __int128 data_ = 0;
+    static TestResults128 from_words(const uint64_t *words, int num_words) {
+        TestResults128 r;
+        if (num_words >= 1) r.data_ = words[0];
+        if (num_words == 2) r.data_ |= (unsigned __int128)(words[1]) << 64;
+        return r;
+    }
+    TestResults128& operator|=(const TestResults128& rhs) { data_ |= rhs.data_; return *this; }
+    uint64_t hash() const { return mix(mix(uint64_t(data_ >> 64)) ^ uint64_t(data_)); }
     friend bool operator<(const TestResults128& a, const TestResults128& b) { return a.data_ < b.data_; }
+    friend bool operator==(const TestResults128& a, const TestResults128& b) { return a.data_ == b.data_; }
+};
+
+template<int W>
+struct TestResultsWide {
+    std::array<uint64_t, W> data_ = {};
+    static TestResultsWide from_words(const uint64_t *words, int num_words) {
+        assert(num_words <= W);
+        TestResultsWide r;
+        std::copy(words, words + num_words, r.data_.begin());
+        return r;
+    }
+    TestResultsWide& operator|=(const TestResultsWide& rhs) {
+        for (int i = 0; i < W; ++i) {
+            data_[i] |= rhs.data_[i];
+        }
+        return *this;
+    }
+    uint64_t hash() const {
+        uint64_t h = 0;
+        for (uint64_t w : data_) h = mix(h ^ w);
+        return h;
+    }
+    friend bool operator<(const TestResultsWide& a, const TestResultsWide& b) { return a.data_ < b.data_; }
+    friend bool operator==(const TestResultsWide& a, const TestResultsWide& b) { return a.data_ == b.data_; }
 };
 
 struct TestResultsBig {
-    std::vector<bool> data_;
-    void push_back(bool b) { data_.push_back(b); }
+    std::vector<uint64_t> data_;
+    static TestResultsBig from_words(const uint64_t *words, int num_words) {
+        TestResultsBig r;
+        r.data_.assign(words, words + num_words);
+        return r;
+    }
+    TestResultsBig& operator|=(const TestResultsBig& rhs) {
+        for (size_t i = 0; i < data_.size(); ++i) {
+            data_[i] |= rhs.data_[i];
+        }
+        return *this;
+    }
+    uint64_t hash() const {
+        uint64_t h = 0;
+        for (uint64_t w : data_) h = mix(h ^ w);
+        return h;
+    }
     friend bool operator<(const TestResultsBig& a, const TestResultsBig& b) { return a.data_ < b.data_; }
+    friend bool operator==(const TestResultsBig& a, const TestResultsBig& b) { return a.data_ == b.data_; }
 };
 
 struct WolfArrangement {
     std::vector<int> v_;
 
-    static WolfArrangement from_index(int n, int d, int id) {
+    // The arrangements are numbered in the order that increment() visits
+    // them, which is colex order; see combinatorics.h.
+    static WolfArrangement from_index(int n, int d, Int id) {
         WolfArrangement result;
-        for (int i=0; i < d; ++i) result.v_.push_back(i);
-        for (int i=0; i < id; ++i) result.increment(n);
+        result.v_.resize(d);
+        unrank_arrangement(id, n, d, result.v_.data());
         return result;
     }
 
@@ -42,37 +117,8 @@ struct WolfArrangement {
         return false;
     }
 
-    template<class F>
-    bool test_is_wolfy(const F& test_contains_animal, int t) const {
-        for (int i : v_) {
-            if (test_contains_animal(t, i)) return true;
-        }
-        return false;
-    }
-
-    void increment(int n) {
-        // Increment the first possible animal index,
-        // and then reset all the previous ones.
-        const int d = v_.size();
-        for (int i=0; i < d-1; ++i) {
-            if (v_[i] + 1 < v_[i+1]) {
-                v_[i] += 1;
-                for (int j = 0; j < i; ++j) {
-                    v_[j] = j;
-                }
-                return;
-            }
-        }
-        if (v_[d-1] + 1 < n) {
-            v_[d-1] += 1;
-            for (int j = 0; j < d-1; ++j) {
-                v_[j] = j;
-            }
-            return;
-        }
-        // Otherwise, increment is impossible.
-        assert(false);
-    }
+    // Returns the index of the wolf that moved; the ones below it have been reset.
+    int increment(int n) { return next_arrangement(v_.data(), v_.size(), n); }
 
     std::string to_string(int n) const {
         std::string result;
@@ -83,68 +129,422 @@ struct WolfArrangement {
     }
 };
 
-static Int add_check(Int a, Int b) {
-    assert(0 <= a);
-    assert(0 <= b && b <= std::numeric_limits<Int>::max() - a);
-    return a + b;
+// Call f(wolves, results) for each arrangement of d wolves among n animals
+// whose index is in [begin, end), in order, until f returns false.
+//
+// An arrangement's results are the OR of its wolves' columns (the tests
+// each animal is in), and we keep above[i], the OR of the columns of
+// wolves i and up. Each increment moves one wolf and resets the ones
+// below it, so only those entries need redoing: the lowest wolf moves on
+// almost every step, and the ones above it only once per full sweep of
+// the ones below, so it's O(1) word operations per arrangement on average.
+template<class TestResults, class F>
+static void for_each_arrangement(int n, int d, const TestMatrix& tests, Int begin, Int end, const F& f)
+{
+    const int num_words = tests.words_per_column();
+    std::vector<TestResults> columns;
+    for (int i=0; i < n; ++i) {
+        columns.push_back(TestResults::from_words(tests.column(i), num_words));
+    }
+    const std::vector<uint64_t> zeros(num_words);
+    const TestResults none = TestResults::from_words(zeros.data(), num_words);
+
+    WolfArrangement wolves = WolfArrangement::from_index(n, d, begin);
+    std::vector<TestResults> above(d+1, none);
+    int moved = d-1;
+    for (Int id=begin; id < end; ++id) {
+        if (id != begin) {
+            moved = wolves.increment(n);
+        }
+        for (int i = moved; i >= 0; --i) {
+            above[i] = above[i+1];
+            above[i] |= columns[wolves.v_[i]];
+        }
+        if (!f(wolves, above[0])) {
+            return;
+        }
+    }
 }
 
-static Int choose(int n, int k) {
-    if (k > n) return Int(0);
-    if (k == 0 || k == n) return Int(1);
-    if (k == 1 || k == n-1) return Int(n);
-    return add_check(choose(n-1, k), choose(n-1, k-1));
+// Split the arrangements into one contiguous range per thread, and call
+// f(begin, end) for each range on a thread of its own.
+template<class F>
+static void for_each_range(Int n_choose_d, int num_threads, const F& f)
+{
+    if (num_threads <= 1 || n_choose_d < Int(num_threads)) {
+        f(Int(0), n_choose_d);
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+        Int begin = n_choose_d / num_threads * i;
+        Int end = (i == num_threads - 1) ? n_choose_d : n_choose_d / num_threads * (i+1);
+        threads.emplace_back([&f, begin, end]() { f(begin, end); });
+    }
+    for (auto&& th : threads) th.join();
 }
 
+// Neither table remembers which arrangement produced which result vector,
+// which would double their size; so once we know a result vector that two
+// arrangements share, we go back and find the first two that produce it.
 template<class TestResults>
-VerifyStrategyResult verify_strategy_impl(int n, int d, const std::vector<std::string>& tests)
+static VerifyStrategyResult failure_with_results(int n, int d, const TestMatrix& tests,
+                                                 const TestResults& duplicate)
 {
-    const Int n_choose_d = choose(n, d);
-    const int t = tests.size();
-    for (auto&& test : tests) {
-        assert(test.size() == n);
+    VerifyStrategyResult result;
+    result.success = false;
+    bool found_one = false;
+    for_each_arrangement<TestResults>(n, d, tests, 0, choose(n, d), [&](const WolfArrangement& wolves, const TestResults& r) {
+        if (r == duplicate) {
+            if (!found_one) {
+                result.w1 = wolves.to_string(n);
+                found_one = true;
+            } else {
+                result.w2 = wolves.to_string(n);
+                return false;
+            }
+        }
+        return true;
+    });
+    assert(!result.w2.empty());
+    return result;
+}
+
+// An open-addressing (linear probing) set of result vectors. It doubles
+// whenever it gets more than 3/4 full, but if it's told how many vectors
+// to expect, it never needs to.
+template<class TestResults>
+class ResultsHashSet {
+    std::vector<TestResults> slots_;
+    std::vector<bool> used_;
+    int shift_;
+    size_t mask_;
+    size_t size_ = 0;
+
+    void allocate(int log2_capacity) {
+        slots_.assign(size_t(1) << log2_capacity, TestResults());
+        used_.assign(size_t(1) << log2_capacity, false);
+        shift_ = 64 - log2_capacity;
+        mask_ = slots_.size() - 1;
     }
 
-    WolfArrangement wolves = WolfArrangement::from_index(n, d, 0);
-    std::map<TestResults, int> test_results_map;
+    void grow() {
+        std::vector<TestResults> old_slots = std::move(slots_);
+        std::vector<bool> old_used = std::move(used_);
+        allocate(64 - shift_ + 1);
+        for (size_t i = 0; i < old_slots.size(); ++i) {
+            if (old_used[i]) insert(old_slots[i]);
+        }
+    }
 
-    auto run_tests = [&]() {
-        auto test_contains_animal = [&](int ti, int ni) {
-            return tests[ti][ni] == '1';
-        };
-        TestResults r;
-        for (int ti=0; ti < t; ++ti) {
-            r.push_back(wolves.test_is_wolfy(test_contains_animal, ti));
+public:
+    explicit ResultsHashSet(Int expected_size) {
+        int log2_capacity = 4;
+        while ((Int(1) << log2_capacity) < expected_size + expected_size / 3) {
+            ++log2_capacity;
         }
-        return r;
+        allocate(log2_capacity);
+    }
+
+    // Returns false if r was already present.
+    bool insert(const TestResults& r) {
+        if (size_ + 1 > slots_.size() / 4 * 3) {
+            size_ = 0;
+            grow();
+        }
+        for (size_t i = r.hash() >> shift_; true; i = (i + 1) & mask_) {
+            if (!used_[i]) {
+                slots_[i] = r;
+                used_[i] = true;
+                size_ += 1;
+                return true;
+            } else if (slots_[i] == r) {
+                return false;
+            }
+        }
+    }
+};
+
+// With several threads inserting at once, the set is split into shards,
+// each behind a mutex of its own, so that two threads rarely want the same one.
+template<class TestResults>
+static VerifyStrategyResult verify_with_hash_table(int n, int d, const TestMatrix& tests, int num_threads)
+{
+    const Int n_choose_d = choose(n, d);
+    const int log2_shards = (num_threads <= 1) ? 0 : 6;
+    struct Shard {
+        std::mutex mtx;
+        ResultsHashSet<TestResults> seen;
+        explicit Shard(Int expected_size) : seen(expected_size) {}
     };
+    std::vector<std::unique_ptr<Shard>> shards;
+    for (int i = 0; i < (1 << log2_shards); ++i) {
+        shards.emplace_back(new Shard(n_choose_d >> log2_shards));
+    }
+
+    std::atomic<bool> failed{false};
+    std::mutex duplicate_mtx;
+    TestResults duplicate;
+    for_each_range(n_choose_d, num_threads, [&](Int begin, Int end) {
+        for_each_arrangement<TestResults>(n, d, tests, begin, end, [&](const WolfArrangement&, const TestResults& r) {
+            // The slot within a shard comes from the top bits of r.hash(),
+            // so pick the shard by some other bits.
+            Shard& shard = *shards[(r.hash() >> 16) & ((1 << log2_shards) - 1)];
+            std::lock_guard<std::mutex> lk(shard.mtx);
+            if (!shard.seen.insert(r)) {
+                std::lock_guard<std::mutex> dlk(duplicate_mtx);
+                if (!failed) duplicate = r;
+                failed = true;
+            }
+            return !failed;
+        });
+    });
+    if (failed) {
+        return failure_with_results(n, d, tests, duplicate);
+    }
+    VerifyStrategyResult result;
+    result.success = true;
+    return result;
+}
+
+// Sort the chunks on a thread apiece, then merge neighbouring runs
+// pairwise (again in parallel) until one run is left.
+template<class T>
+static void parallel_sort(std::vector<T>& v, int num_threads)
+{
+    const size_t num_chunks = std::max(1, num_threads);
+    std::vector<size_t> bounds;
+    for (size_t i = 0; i <= num_chunks; ++i) {
+        bounds.push_back(v.size() * i / num_chunks);
+    }
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_chunks; ++i) {
+        threads.emplace_back([&, i]() {
+            std::sort(v.begin() + bounds[i], v.begin() + bounds[i+1]);
+        });
+    }
+    for (auto&& th : threads) th.join();
 
-    test_results_map.insert(std::make_pair(run_tests(), 0));
-    for (Int id=1; id < n_choose_d; ++id) {
-        wolves.increment(n);
-        auto ii = test_results_map.insert(std::make_pair(run_tests(), id));
-        if (ii.second == false) {
-            int old_id = ii.first->second;
-            VerifyStrategyResult result;
-            result.success = false;
-            result.w1 = WolfArrangement::from_index(n, d, old_id).to_string(n);
-            result.w2 = wolves.to_string(n);
-            return result;
+    while (bounds.size() > 2) {
+        std::vector<size_t> merged_bounds;
+        threads.clear();
+        for (size_t i = 0; i + 1 < bounds.size(); i += 2) {
+            merged_bounds.push_back(bounds[i]);
+            if (i + 2 < bounds.size()) {
+                threads.emplace_back([&, i]() {
+                    std::inplace_merge(v.begin() + bounds[i], v.begin() + bounds[i+1], v.begin() + bounds[i+2]);
+                });
+            }
         }
+        merged_bounds.push_back(bounds.back());
+        for (auto&& th : threads) th.join();
+        bounds = std::move(merged_bounds);
+    }
+}
+
+// Each thread fills in its own slice of the array; duplicates between
+// slices come together when the whole array is sorted.
+template<class TestResults>
+static VerifyStrategyResult verify_with_sorted_array(int n, int d, const TestMatrix& tests, int num_threads)
+{
+    const Int n_choose_d = choose(n, d);
+    std::vector<TestResults> all_results(n_choose_d);
+    for_each_range(n_choose_d, num_threads, [&](Int begin, Int end) {
+        Int id = begin;
+        for_each_arrangement<TestResults>(n, d, tests, begin, end, [&](const WolfArrangement&, const TestResults& r) {
+            all_results[id++] = r;
+            return true;
+        });
+    });
+    parallel_sort(all_results, num_threads);
+    auto it = std::adjacent_find(all_results.begin(), all_results.end());
+    if (it != all_results.end()) {
+        TestResults duplicate = *it;
+        all_results = std::vector<TestResults>();
+        return failure_with_results(n, d, tests, duplicate);
+    }
+    VerifyStrategyResult result;
+    result.success = true;
+    return result;
+}
+
+#ifdef WOLVES_CUDA
+// The device only says which result vector is shared; the two arrangements
+// that share it are found here, just as for the other methods.
+static bool verify_on_gpu(int n, int d, const TestMatrix& tests, VerifyStrategyResult *result)
+{
+    std::vector<uint64_t> duplicate;
+    switch (find_duplicate_on_gpu(tests, d, &duplicate)) {
+        case GpuVerdict::Separable:
+            result->success = true;
+            return true;
+        case GpuVerdict::Duplicate:
+            if (tests.num_tests() <= 64) {
+                *result = failure_with_results(n, d, tests, TestResults64::from_words(duplicate.data(), duplicate.size()));
+            } else {
+                *result = failure_with_results(n, d, tests, TestResults128::from_words(duplicate.data(), duplicate.size()));
+            }
+            return true;
+        case GpuVerdict::Unavailable:
+            return false;
+    }
+    assert(false);
+}
+#endif
+
+template<class TestResults>
+static VerifyStrategyResult verify_strategy_impl(int n, int d, const TestMatrix& tests,
+                                                 VerifyMethod method, int num_threads)
+{
+    switch (method) {
+        case VerifyMethod::HashTable: return verify_with_hash_table<TestResults>(n, d, tests, num_threads);
+        case VerifyMethod::SortedArray: return verify_with_sorted_array<TestResults>(n, d, tests, num_threads);
+        case VerifyMethod::Gpu: return verify_with_sorted_array<TestResults>(n, d, tests, num_threads);
+    }
+    assert(false);
+}
+
+static std::string arrangement_string(int n, const std::vector<int>& wolves)
+{
+    std::string result(n, '.');
+    for (int w : wolves) result[w] = '1';
+    return result;
+}
+
+template<class TestResults>
+static VerifyStrategyResult sample_strategy_impl(int n, int d, const TestMatrix& tests,
+                                                 unsigned long long max_arrangements, uint64_t seed)
+{
+    const int num_words = tests.words_per_column();
+    std::vector<TestResults> columns;
+    for (int i = 0; i < n; ++i) {
+        columns.push_back(TestResults::from_words(tests.column(i), num_words));
     }
+    const std::vector<uint64_t> zeros(num_words);
+    const TestResults none = TestResults::from_words(zeros.data(), num_words);
 
     VerifyStrategyResult result;
     result.success = true;
+    auto fail = [&](const std::vector<int>& a, const std::vector<int>& b) {
+        result.success = false;
+        result.w1 = arrangement_string(n, a);
+        result.w2 = arrangement_string(n, b);
+    };
+
+    // Each sample costs itself and its d*(n-d) neighbours.
+    const unsigned long long per_sample = 1 + (unsigned long long)d * (n - d);
+    const unsigned long long num_samples = std::max(1ull, std::min(max_arrangements / per_sample, choose_saturated(n, d)));
+    std::mt19937_64 rng(seed);
+    std::vector<std::vector<int>> samples;
+    std::unordered_multimap<uint64_t, size_t> seen;
+    std::vector<TestResults> above(d + 1, none);
+    std::vector<TestResults> below(d + 1, none);
+    std::vector<bool> is_wolf(n);
+    for (unsigned long long s = 0; s < num_samples; ++s) {
+        // Floyd's algorithm for d distinct animals, in increasing order.
+        std::vector<int> wolves;
+        for (int j = n - d; j < n; ++j) {
+            int a = std::uniform_int_distribution<int>(0, j)(rng);
+            wolves.push_back(std::find(wolves.begin(), wolves.end(), a) == wolves.end() ? a : j);
+        }
+        std::sort(wolves.begin(), wolves.end());
+
+        // below[i] is the OR of wolves [0, i), above[i] of wolves [i, d).
+        for (int i = 0; i < d; ++i) {
+            below[i+1] = below[i];
+            below[i+1] |= columns[wolves[i]];
+        }
+        for (int i = d - 1; i >= 0; --i) {
+            above[i] = above[i+1];
+            above[i] |= columns[wolves[i]];
+        }
+        const TestResults r = above[0];
+
+        auto range = seen.equal_range(r.hash());
+        for (auto it = range.first; it != range.second; ++it) {
+            const std::vector<int>& other = samples[it->second];
+            TestResults other_r = none;
+            for (int w : other) other_r |= columns[w];
+            if (other_r == r && other != wolves) {
+                fail(other, wolves);
+                return result;
+            }
+        }
+
+        for (int w : wolves) is_wolf[w] = true;
+        for (int i = 0; i < d; ++i) {
+            TestResults others = below[i];
+            others |= above[i+1];
+            for (int x = 0; x < n; ++x) {
+                if (is_wolf[x]) continue;
+                TestResults neighbour = others;
+                neighbour |= columns[x];
+                if (neighbour == r) {
+                    std::vector<int> swapped = wolves;
+                    swapped[i] = x;
+                    std::sort(swapped.begin(), swapped.end());
+                    fail(wolves, swapped);
+                    return result;
+                }
+            }
+        }
+        for (int w : wolves) is_wolf[w] = false;
+
+        seen.emplace(r.hash(), samples.size());
+        samples.push_back(std::move(wolves));
+    }
     return result;
 }
 
-VerifyStrategyResult verify_strategy(int n, int d, const std::vector<std::string>& tests)
+VerifyStrategyResult sample_strategy(const TestMatrix& tests, int d, unsigned long long max_arrangements, uint64_t seed)
+{
+    const int n = tests.num_animals();
+    assert(0 <= d && d <= n);
+    if (d == 0 || d == n) {
+        VerifyStrategyResult result;
+        result.success = true;
+        return result;
+    }
+    if (tests.num_tests() <= 64) {
+        return sample_strategy_impl<TestResults64>(n, d, tests, max_arrangements, seed);
+    } else if (tests.num_tests() <= 128) {
+        return sample_strategy_impl<TestResults128>(n, d, tests, max_arrangements, seed);
+    } else if (tests.num_tests() <= 256) {
+        return sample_strategy_impl<TestResultsWide<4>>(n, d, tests, max_arrangements, seed);
+    } else if (tests.num_tests() <= 1024) {
+        return sample_strategy_impl<TestResultsWide<16>>(n, d, tests, max_arrangements, seed);
+    } else {
+        return sample_strategy_impl<TestResultsBig>(n, d, tests, max_arrangements, seed);
+    }
+}
+
+bool verifier_has_gpu()
+{
+#ifdef WOLVES_CUDA
+    return true;
+#else
+    return false;
+#endif
+}
+
+VerifyStrategyResult verify_strategy(const TestMatrix& tests, int d, VerifyMethod method, int num_threads)
 {
-    if (tests.size() <= 64) {
-        return verify_strategy_impl<TestResults64>(n, d, tests);
-    } else if (tests.size() <= 128) {
-        return verify_strategy_impl<TestResults128>(n, d, tests);
+    const int n = tests.num_animals();
+#ifdef WOLVES_CUDA
+    VerifyStrategyResult result;
+    if (method == VerifyMethod::Gpu && verify_on_gpu(n, d, tests, &result)) {
+        return result;
+    }
+#endif
+    if (tests.num_tests() <= 64) {
+        return verify_strategy_impl<TestResults64>(n, d, tests, method, num_threads);
+    } else if (tests.num_tests() <= 128) {
+        return verify_strategy_impl<TestResults128>(n, d, tests, method, num_threads);
+    } else if (tests.num_tests() <= 256) {
+        return verify_strategy_impl<TestResultsWide<4>>(n, d, tests, method, num_threads);
+    } else if (tests.num_tests() <= 1024) {
+        return verify_strategy_impl<TestResultsWide<16>>(n, d, tests, method, num_threads);
     } else {
-        return verify_strategy_impl<TestResultsBig>(n, d, tests);
+        return verify_strategy_impl<TestResultsBig>(n, d, tests, method, num_threads);
     }
 }
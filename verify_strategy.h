@@ -1,7 +1,8 @@
 #pragma once
 
+#include <stdint.h>
 #include <string>
-#include <vector>
+#include "test_matrix.h"
 
 struct VerifyStrategyResult {
     bool success;
@@ -10,4 +11,32 @@ struct VerifyStrategyResult {
     std::string w2;
 };
 
-VerifyStrategyResult verify_strategy(int n, int d, const std::vector<std::string>& tests);
+// How verify_strategy looks for two arrangements with the same test results.
+// The sorted array takes the least memory (one result vector per arrangement);
+// the hash table takes about half again as much, but it stops at the first
+// duplicate instead of computing every result vector before it looks. The GPU
+// does what the sorted array does, on the device (see verify_strategy_gpu.h);
+// without one, or for a strategy it can't handle, that's what it falls back to.
+enum class VerifyMethod {
+    SortedArray,  // compute them all into one flat array, sort it, and compare neighbours
+    HashTable,    // insert each result vector into an open-addressing table as it's computed
+    Gpu,          // the sorted array on a CUDA device, in as many passes as its memory needs
+};
+
+// Whether this build can verify on a GPU ("make CUDA=1").
+bool verifier_has_gpu();
+
+// The arrangements are split into num_threads ranges, whose result vectors
+// are computed in parallel and then checked against each other.
+VerifyStrategyResult verify_strategy(const TestMatrix& tests, int d,
+                                     VerifyMethod method = VerifyMethod::SortedArray, int num_threads = 1);
+
+// A cheap look for a collision before the exhaustive check. It picks
+// arrangements at random, and compares each one's results with those of the
+// other random ones and with those of every arrangement that swaps one of its
+// wolves for a sheep, since that's where collisions cluster; in all it looks
+// at about max_arrangements arrangements. If it finds two with the same
+// results, the failure is as real as one from verify_strategy; a success only
+// means it found none, and the strategy still needs verifying in full.
+VerifyStrategyResult sample_strategy(const TestMatrix& tests, int d, unsigned long long max_arrangements,
+                                     uint64_t seed = 0);
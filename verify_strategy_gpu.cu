@@ -0,0 +1,254 @@
+#include "verify_strategy_gpu.h"
+#include "combinatorics.h"
+
+#include <algorithm>
+#include <cuda_runtime.h>
+#include <limits>
+#include <stdio.h>
+#include <thrust/device_ptr.h>
+#include <thrust/execution_policy.h>
+#include <thrust/mismatch.h>
+#include <thrust/sort.h>
+#include <vector>
+
+using Int = unsigned long long;
+
+static constexpr int max_gpu_wolves = 16;
+
+// Each thread steps through this many consecutive arrangements, so that the
+// cost of unranking the first one is spread over the rest.
+static constexpr Int arrangements_per_thread = 256;
+static constexpr int threads_per_block = 256;
+
+__host__ __device__ static inline uint64_t mix(uint64_t x) { return x * 0x9E3779B97F4A7C15uLL; }
+
+struct Results64 {
+    uint64_t w0;
+    static Results64 from_words(const uint64_t *words, int num_words) { return Results64{num_words ? words[0] : 0}; }
+    void to_words(uint64_t *words, int num_words) const { if (num_words) words[0] = w0; }
+    __host__ __device__ Results64& operator|=(const Results64& rhs) { w0 |= rhs.w0; return *this; }
+    __host__ __device__ uint64_t hash() const { return mix(w0); }
+    __host__ __device__ friend bool operator<(const Results64& a, const Results64& b) { return a.w0 < b.w0; }
+    __host__ __device__ friend bool operator==(const Results64& a, const Results64& b) { return a.w0 == b.w0; }
+};
+
+struct Results128 {
+    uint64_t w0, w1;
+    static Results128 from_words(const uint64_t *words, int num_words) {
+        return Results128{num_words >= 1 ? words[0] : 0, num_words >= 2 ? words[1] : 0};
+    }
+    void to_words(uint64_t *words, int num_words) const {
+        if (num_words >= 1) words[0] = w0;
+        if (num_words >= 2) words[1] = w1;
+    }
+    __host__ __device__ Results128& operator|=(const Results128& rhs) { w0 |= rhs.w0; w1 |= rhs.w1; return *this; }
+    __host__ __device__ uint64_t hash() const { return mix(mix(w1) ^ w0); }
+    __host__ __device__ friend bool operator<(const Results128& a, const Results128& b) {
+        return (a.w1 != b.w1) ? (a.w1 < b.w1) : (a.w0 < b.w0);
+    }
+    __host__ __device__ friend bool operator==(const Results128& a, const Results128& b) {
+        return a.w0 == b.w0 && a.w1 == b.w1;
+    }
+};
+
+struct NotEqual {
+    template<class R>
+    __host__ __device__ bool operator()(const R& a, const R& b) const { return !(a == b); }
+};
+
+// Which of num_buckets passes a result vector belongs to. The bits are taken
+// from the top of the hash, which are the best mixed.
+template<class R>
+__host__ __device__ static inline unsigned bucket_of(const R& r, unsigned num_buckets)
+{
+    return unsigned((r.hash() >> 32) % num_buckets);
+}
+
+// Write the results of each arrangement in this thread's run that belong to
+// the given bucket to out[], at the next free slot counted by *out_count. A
+// slot past capacity is counted but not written, so the host can tell that
+// the bucket overflowed. binom[c * (d+1) + j] is C(c, j), saturated at the
+// largest Int.
+//
+// The arrangements are numbered in colex order, as verify_strategy numbers
+// them, and stepped through the same way: above[i] is the OR of the columns
+// of wolves i and up, and only the entries at and below the wolf that moved
+// are redone.
+template<class R>
+__global__ static void compute_bucket(const R *columns, int n, int d, const Int *binom, Int n_choose_d,
+                                      unsigned num_buckets, unsigned bucket,
+                                      R *out, Int *out_count, Int capacity)
+{
+    const Int first = (Int(blockIdx.x) * blockDim.x + threadIdx.x) * arrangements_per_thread;
+    if (first >= n_choose_d) {
+        return;
+    }
+    const Int last = (n_choose_d - first < arrangements_per_thread) ? n_choose_d : first + arrangements_per_thread;
+
+    int v[max_gpu_wolves];
+    Int id = first;
+    for (int i = d - 1, c = n; i >= 0; --i) {
+        do {
+            c -= 1;
+        } while (binom[c * (d+1) + (i+1)] > id);
+        v[i] = c;
+        id -= binom[c * (d+1) + (i+1)];
+    }
+
+    R above[max_gpu_wolves + 1];
+    above[d] = R{};
+    int moved = d - 1;
+    for (Int a = first; a < last; ++a) {
+        if (a != first) {
+            // Move the lowest wolf that can move up by one, and reset the ones below it.
+            moved = d - 1;
+            for (int i = 0; i < d - 1; ++i) {
+                if (v[i] + 1 < v[i+1]) {
+                    moved = i;
+                    break;
+                }
+            }
+            v[moved] += 1;
+            for (int j = 0; j < moved; ++j) {
+                v[j] = j;
+            }
+        }
+        for (int i = moved; i >= 0; --i) {
+            above[i] = above[i+1];
+            above[i] |= columns[v[i]];
+        }
+        if (num_buckets == 1 || bucket_of(above[0], num_buckets) == bucket) {
+            Int slot = atomicAdd(out_count, Int(1));
+            if (slot < capacity) {
+                out[slot] = above[0];
+            }
+        }
+    }
+}
+
+// Device memory that frees itself.
+template<class T>
+struct DeviceArray {
+    T *p = nullptr;
+    cudaError_t allocate(size_t count) { return cudaMalloc(&p, count * sizeof(T)); }
+    ~DeviceArray() { if (p != nullptr) cudaFree(p); }
+};
+
+static GpuVerdict unavailable(const char *what, cudaError_t err)
+{
+    fprintf(stderr, "GPU verification unavailable (%s: %s); using the CPU\n", what, cudaGetErrorString(err));
+    return GpuVerdict::Unavailable;
+}
+
+template<class R>
+static GpuVerdict find_duplicate(const TestMatrix& tests, int d, std::vector<uint64_t> *duplicate)
+{
+    const int n = tests.num_animals();
+    const int num_words = tests.words_per_column();
+
+    // C(c, j) for every c <= n and j <= d; any that won't fit in an Int are
+    // saturated, which unranking copes with, since no id is that large.
+    std::vector<Int> binom(size_t(n + 1) * (d + 1));
+    for (int c = 0; c <= n; ++c) {
+        for (int j = 0; j <= d; ++j) {
+            binom[c * (d+1) + j] = choose_saturated(c, j);
+        }
+    }
+    const Int n_choose_d = binom[n * (d+1) + d];
+    if (n_choose_d == std::numeric_limits<Int>::max()) {
+        fprintf(stderr, "GPU verification unavailable (C(%d,%d) is too many arrangements); using the CPU\n", n, d);
+        return GpuVerdict::Unavailable;
+    }
+
+    std::vector<R> host_columns;
+    for (int i = 0; i < n; ++i) {
+        host_columns.push_back(R::from_words(tests.column(i), num_words));
+    }
+
+    cudaError_t err;
+    DeviceArray<R> columns;
+    DeviceArray<Int> device_binom;
+    DeviceArray<Int> out_count;
+    if ((err = columns.allocate(std::max(n, 1))) != cudaSuccess ||
+        (err = device_binom.allocate(binom.size())) != cudaSuccess ||
+        (err = out_count.allocate(1)) != cudaSuccess) {
+        return unavailable("cudaMalloc", err);
+    }
+    if ((err = cudaMemcpy(columns.p, host_columns.data(), n * sizeof(R), cudaMemcpyHostToDevice)) != cudaSuccess ||
+        (err = cudaMemcpy(device_binom.p, binom.data(), binom.size() * sizeof(Int), cudaMemcpyHostToDevice)) != cudaSuccess) {
+        return unavailable("cudaMemcpy", err);
+    }
+
+    // Leave the sort as much room again as the bucket it's sorting, and
+    // thrust a little more besides.
+    size_t free_bytes, total_bytes;
+    if ((err = cudaMemGetInfo(&free_bytes, &total_bytes)) != cudaSuccess) {
+        return unavailable("cudaMemGetInfo", err);
+    }
+    const Int slots = std::min<Int>(std::max<Int>(n_choose_d, 1), free_bytes / 2 / sizeof(R) / 16 * 15);
+    DeviceArray<R> out;
+    if (slots == 0 || (err = out.allocate(slots)) != cudaSuccess) {
+        return unavailable("cudaMalloc", (slots == 0) ? cudaErrorMemoryAllocation : err);
+    }
+
+    // If it won't all fit at once, a bucket gets about nine tenths of the
+    // room, to allow for them not coming out quite even; if one overflows
+    // anyway, start again with twice as many buckets.
+    const Int room = std::max<Int>(1, slots - slots / 10);
+    Int num_buckets = (n_choose_d <= slots) ? 1 : (n_choose_d + room - 1) / room;
+    const Int num_threads = (n_choose_d + arrangements_per_thread - 1) / arrangements_per_thread;
+    const unsigned num_blocks = unsigned((num_threads + threads_per_block - 1) / threads_per_block);
+    Int bucket = 0;
+    while (bucket < num_buckets) {
+        if ((err = cudaMemset(out_count.p, 0, sizeof(Int))) != cudaSuccess) {
+            return unavailable("cudaMemset", err);
+        }
+        compute_bucket<R><<<num_blocks, threads_per_block>>>(columns.p, n, d, device_binom.p, n_choose_d,
+                                                             unsigned(num_buckets), unsigned(bucket),
+                                                             out.p, out_count.p, slots);
+        if ((err = cudaGetLastError()) != cudaSuccess || (err = cudaDeviceSynchronize()) != cudaSuccess) {
+            return unavailable("compute_bucket", err);
+        }
+        Int count;
+        if ((err = cudaMemcpy(&count, out_count.p, sizeof(Int), cudaMemcpyDeviceToHost)) != cudaSuccess) {
+            return unavailable("cudaMemcpy", err);
+        }
+        if (count > slots) {
+            num_buckets *= 2;
+            bucket = 0;
+            continue;
+        }
+
+        // Two equal neighbours, once sorted, are two arrangements that the tests can't tell apart.
+        thrust::device_ptr<R> begin(out.p);
+        thrust::device_ptr<R> end = begin + count;
+        thrust::sort(thrust::device, begin, end);
+        if (count >= 2) {
+            auto it = thrust::mismatch(thrust::device, begin, end - 1, begin + 1, NotEqual()).first;
+            if (it != end - 1) {
+                R r;
+                if ((err = cudaMemcpy(&r, thrust::raw_pointer_cast(it), sizeof(R), cudaMemcpyDeviceToHost)) != cudaSuccess) {
+                    return unavailable("cudaMemcpy", err);
+                }
+                duplicate->assign(num_words, 0);
+                r.to_words(duplicate->data(), num_words);
+                return GpuVerdict::Duplicate;
+            }
+        }
+        bucket += 1;
+    }
+    return GpuVerdict::Separable;
+}
+
+GpuVerdict find_duplicate_on_gpu(const TestMatrix& tests, int d, std::vector<uint64_t> *duplicate)
+{
+    if (d < 1 || d > max_gpu_wolves || d > tests.num_animals() || tests.num_tests() > 128) {
+        fprintf(stderr, "GPU verification handles 1 to %d wolves and at most 128 tests; using the CPU\n", max_gpu_wolves);
+        return GpuVerdict::Unavailable;
+    }
+    if (tests.num_tests() <= 64) {
+        return find_duplicate<Results64>(tests, d, duplicate);
+    } else {
+        return find_duplicate<Results128>(tests, d, duplicate);
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "test_matrix.h"
+
+// The CUDA half of VerifyMethod::Gpu, built only with "make CUDA=1". The
+// columns are uploaded once; each GPU thread unranks the first of a run of
+// arrangements and steps through the rest, ORing their wolves' columns, and
+// the result vectors are sorted on the device and compared with their
+// neighbours. If the C(n,d) results won't fit in the device's memory at once,
+// they're split by hash into buckets and each bucket gets a pass of its own.
+// Only a result vector that two arrangements share ever comes back; finding
+// the two arrangements is left to the host.
+
+enum class GpuVerdict {
+    Separable,    // no two arrangements give the same results
+    Duplicate,    // *duplicate holds results that two arrangements give
+    Unavailable,  // no device, too many tests or wolves, or a CUDA error; said why on stderr
+};
+
+// At most 128 tests and 16 wolves. On Duplicate, *duplicate gets words_per_column() words.
+GpuVerdict find_duplicate_on_gpu(const TestMatrix& tests, int d, std::vector<uint64_t> *duplicate);
@@ -1,20 +1,28 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <limits.h>
+#include <math.h>
+#include <mutex>
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string>
+#include <thread>
+#include <unordered_set>
 #include <vector>
+#include "combinatorics.h"
 #include "wolves.h"
+#ifdef WOLVES_NAUTY
+#include "canonical_form.h"
+#include "test_matrix.h"
+#endif
 
 using Int = unsigned long long;
 
-static Int choose(int n, int k) {
-    if (k > n) return Int(0);
-    if (k == 0 || k == n) return Int(1);
-    if (k == 1 || k == n-1) return Int(n);
-    return choose(n-1, k) + choose(n-1, k-1);
-}
-
 static inline
 int ceil_div(int x, int y) {
     return (x + y - 1) / y;
@@ -22,19 +30,79 @@ int ceil_div(int x, int y) {
 
 static inline
 int ceil_lg(Int value) {
-    Int r = 0;
-    while (value > (Int(1) << r)) {
+    int r = 0;
+    while (r < 64 && value > (Int(1) << r)) {
         ++r;
     }
     return r;
 }
 
+// Sets of animals (wolf arrangements and tests) are bitmasks with one bit per animal.
+// The search is instantiated for each of these widths, so that the common small
+// instances still run on single machine words.
+using Bits64 = unsigned long long;
+using Bits128 = unsigned __int128;
+
+struct Bits256 {
+    uint64_t w[4];
+
+    Bits256() = default;
+    constexpr Bits256(unsigned long long v) : w{v, 0, 0, 0} {}
+
+    explicit operator bool() const { return (w[0] | w[1] | w[2] | w[3]) != 0; }
+
+    Bits256& operator&=(const Bits256& b) {
+        for (int i=0; i < 4; ++i) w[i] &= b.w[i];
+        return *this;
+    }
+    Bits256& operator|=(const Bits256& b) {
+        for (int i=0; i < 4; ++i) w[i] |= b.w[i];
+        return *this;
+    }
+    Bits256& operator<<=(int s) {
+        assert(0 <= s && s < 256);
+        const int words = s / 64;
+        const int bits = s % 64;
+        for (int i = 3; i >= 0; --i) {
+            uint64_t hi = (i - words >= 0) ? w[i - words] : 0;
+            uint64_t lo = (i - words - 1 >= 0) ? w[i - words - 1] : 0;
+            w[i] = (bits == 0) ? hi : ((hi << bits) | (lo >> (64 - bits)));
+        }
+        return *this;
+    }
+    Bits256& operator++() {
+        for (int i=0; i < 4; ++i) {
+            if (++w[i] != 0) break;
+        }
+        return *this;
+    }
+    Bits256& operator--() {
+        for (int i=0; i < 4; ++i) {
+            if (w[i]-- != 0) break;
+        }
+        return *this;
+    }
+    friend Bits256 operator&(Bits256 a, const Bits256& b) { a &= b; return a; }
+    friend Bits256 operator|(Bits256 a, const Bits256& b) { a |= b; return a; }
+    friend Bits256 operator<<(Bits256 a, int s) { a <<= s; return a; }
+    friend bool operator==(const Bits256& a, const Bits256& b) {
+        return a.w[0] == b.w[0] && a.w[1] == b.w[1] && a.w[2] == b.w[2] && a.w[3] == b.w[3];
+    }
+    friend bool operator!=(const Bits256& a, const Bits256& b) { return !(a == b); }
+    friend bool operator<(const Bits256& a, const Bits256& b) {
+        for (int i = 3; i >= 0; --i) {
+            if (a.w[i] != b.w[i]) return a.w[i] < b.w[i];
+        }
+        return false;
+    }
+};
+
 static inline
-int popcount(Int value) {
+int popcount(Bits64 value) {
 #if 1
     return __builtin_popcountll(value);
 #else
-    Int bit = 1;
+    Bits64 bit = 1;
     int result = 0;
     while (bit <= value) {
         if (value & bit) ++result;
@@ -45,12 +113,36 @@ int popcount(Int value) {
 }
 
 static inline
-bool is_power_of_2_minus_1(Int x) {
-    Int y = x;
+int popcount(Bits128 value) {
+    return __builtin_popcountll(uint64_t(value)) + __builtin_popcountll(uint64_t(value >> 64));
+}
+
+static inline
+int popcount(const Bits256& value) {
+    int result = 0;
+    for (int i=0; i < 4; ++i) result += __builtin_popcountll(value.w[i]);
+    return result;
+}
+
+template<class Bits>
+static inline
+bool is_power_of_2_minus_1(const Bits& x) {
+    Bits y = x;
     ++y;
     return (y & x) == 0;
 }
 
+// A 64-bit finalizer (splitmix64's): every bit of the result depends on every bit of x.
+static inline
+uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
 static std::string format(const char *fmt, ...) {
     va_list ap;
     va_start(ap, fmt);
@@ -72,32 +164,250 @@ static std::string format(const char *fmt, ...) {
     return result;
 }
 
-struct Candidate {
-    Int is_wolf;  // n bits, has exactly k nonzero bits
-    Int test_results;  // t bits, each representing the result of a test
-    explicit Candidate(Int v) : is_wolf(v) {}
+struct CandidateGroup {
+    // A range of TestingState::cands that all gave identical results for the tests so far.
+    size_t begin;
+    size_t end;
+};
+
+SearchStats& SearchStats::operator+=(const SearchStats& rhs)
+{
+    for (int d = 0; d < max_depth; ++d) {
+        nodes[d] += rhs.nodes[d];
+        masks[d] += rhs.masks[d];
+        for (int r = 0; r < NumPruneReasons; ++r) {
+            pruned[r][d] += rhs.pruned[r][d];
+        }
+    }
+    return *this;
+}
+
+SearchStats& SearchStats::operator-=(const SearchStats& rhs)
+{
+    for (int d = 0; d < max_depth; ++d) {
+        nodes[d] -= rhs.nodes[d];
+        masks[d] -= rhs.masks[d];
+        for (int r = 0; r < NumPruneReasons; ++r) {
+            pruned[r][d] -= rhs.pruned[r][d];
+        }
+    }
+    return *this;
+}
+
+unsigned long long SearchStats::total_nodes() const
+{
+    unsigned long long total = 0;
+    for (int d = 0; d < max_depth; ++d) {
+        total += nodes[d];
+    }
+    return total;
+}
+
+std::string format_search_stats(const SearchStats& stats, double seconds)
+{
+    static const char *const names[NumPruneReasons] = {
+        "pigeonhole", "unacceptable", "out-of-order", "population", "column-order", "information",
+        "isomorph"
+    };
+    unsigned long long nodes = stats.total_nodes();
+    std::string result = format("%llu nodes in %.1fs (%.0f nodes/s)\n", nodes, seconds, (seconds > 0) ? nodes / seconds : 0.0);
+    result += format("  %5s %14s %14s", "depth", "nodes", "tests");
+    for (int r = 0; r < NumPruneReasons; ++r) {
+        result += format(" %14s", names[r]);
+    }
+    result += "\n";
+    SearchStats totals;
+    for (int d = 0; d < SearchStats::max_depth; ++d) {
+        if (stats.nodes[d] == 0) continue;
+        result += format("  %5d %14llu %14llu", d, stats.nodes[d], stats.masks[d]);
+        for (int r = 0; r < NumPruneReasons; ++r) {
+            result += format(" %14llu", stats.pruned[r][d]);
+            totals.pruned[r][0] += stats.pruned[r][d];
+        }
+        result += "\n";
+        totals.masks[0] += stats.masks[d];
+    }
+    // The pigeonhole rule prunes nodes; the others prune tests.
+    result += format("  %5s %14llu %14llu", "all", nodes, totals.masks[0]);
+    for (int r = 0; r < NumPruneReasons; ++r) {
+        unsigned long long whole = (r == PrunedByPigeonhole) ? nodes : totals.masks[0];
+        result += format(" %13.1f%%", whole ? 100.0 * totals.pruned[r][0] / whole : 0.0);
+    }
+    result += "\n";
+    return result;
+}
+
+namespace {
+#ifdef WOLVES_STATS
+// One search thread's counters. Only that thread writes them, so a relaxed load
+// and store (rather than a locked increment) is enough, and other threads can
+// still read them at any time for search_stats_so_far().
+struct LiveStats {
+    std::atomic<unsigned long long> nodes[SearchStats::max_depth] = {};
+    std::atomic<unsigned long long> masks[SearchStats::max_depth] = {};
+    std::atomic<unsigned long long> pruned[NumPruneReasons][SearchStats::max_depth] = {};
+    SearchStats *solve_stats;
+
+    explicit LiveStats(SearchStats *solve_stats);
+    ~LiveStats();
+    SearchStats snapshot() const;
+};
+
+struct StatsRegistry {
+    std::mutex mtx;
+    SearchStats finished;
+    std::vector<const LiveStats *> live;
+};
+
+static StatsRegistry& stats_registry()
+{
+    static StatsRegistry registry;
+    return registry;
+}
+
+LiveStats::LiveStats(SearchStats *solve_stats) : solve_stats(solve_stats)
+{
+    StatsRegistry& registry = stats_registry();
+    std::lock_guard<std::mutex> lk(registry.mtx);
+    registry.live.push_back(this);
+}
+
+LiveStats::~LiveStats()
+{
+    SearchStats mine = snapshot();
+    StatsRegistry& registry = stats_registry();
+    std::lock_guard<std::mutex> lk(registry.mtx);
+    registry.finished += mine;
+    if (solve_stats != nullptr) {
+        *solve_stats += mine;
+    }
+    registry.live.erase(std::find(registry.live.begin(), registry.live.end(), this));
+}
+
+SearchStats LiveStats::snapshot() const
+{
+    SearchStats result;
+    for (int d = 0; d < SearchStats::max_depth; ++d) {
+        result.nodes[d] = nodes[d].load(std::memory_order_relaxed);
+        result.masks[d] = masks[d].load(std::memory_order_relaxed);
+        for (int r = 0; r < NumPruneReasons; ++r) {
+            result.pruned[r][d] = pruned[r][d].load(std::memory_order_relaxed);
+        }
+    }
+    return result;
+}
+
+static inline void bump(std::atomic<unsigned long long>& counter)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+#define COUNT_STAT(state, counter, depth) bump((state).stats->counter[std::min(depth, SearchStats::max_depth - 1)])
+#else
+struct LiveStats {
+    explicit LiveStats(SearchStats *) {}
 };
 
-static std::vector<Candidate> make_candidates(int n, int k) {
+#define COUNT_STAT(state, counter, depth) ((void)0)
+#endif
+} // anonymous namespace
+
+SearchStats search_stats_so_far()
+{
+    SearchStats result;
+#ifdef WOLVES_STATS
+    StatsRegistry& registry = stats_registry();
+    std::lock_guard<std::mutex> lk(registry.mtx);
+    result = registry.finished;
+    for (const LiveStats *live : registry.live) {
+        result += live->snapshot();
+    }
+#endif
+    return result;
+}
+
+// Each candidate is an n-bit mask of which animals are wolves; it has exactly k nonzero bits.
+// They come out ordered by whether animal 0 is a wolf, then by animal 1, and so on,
+// sheep before wolf. Counting the animals from the last one, that's the k-subsets in
+// colexicographic order, which is easy to step through; the search visits the
+// candidates in this order, so it's kept exactly.
+template<class Bits>
+static std::vector<Bits> make_candidates(int n, int k) {
     assert(n >= 0);
     assert(k >= 0);
-    if (k == 0) {
-        return std::vector<Candidate>{ Candidate(0) };
-    } else if (k > n) {
-        return std::vector<Candidate>{};
-    } else {
-        std::vector<Candidate> a = make_candidates(n-1, k);
-        std::vector<Candidate> b = make_candidates(n-1, k-1);
-        for (auto&& cand : a) cand.is_wolf <<= 1;
-        for (auto&& cand : b) cand.is_wolf = (cand.is_wolf << 1) | 1;
-        a.reserve(a.size() + b.size());
-        for (auto&& cand : b) { a.push_back(std::move(cand)); }
-        return a;
+    std::vector<Bits> result;
+    if (k > n) {
+        return result;
+    }
+    result.reserve(choose(n, k));
+    // The wolves, counted from the last animal, in increasing order; pos[k] is a sentinel.
+    std::vector<int> pos(k + 1);
+    for (int j = 0; j < k; ++j) pos[j] = j;
+    pos[k] = n;
+    while (true) {
+        Bits cand = Bits(0);
+        for (int j = 0; j < k; ++j) cand |= (Bits(1) << (n - 1 - pos[j]));
+        result.push_back(cand);
+        int j = 0;
+        while (j < k && pos[j] + 1 == pos[j+1]) {
+            pos[j] = j;
+            ++j;
+        }
+        if (j == k) break;
+        ++pos[j];
     }
+    return result;
 }
 
-static void report_solution(const std::vector<Int>& solution, int n, int t, const std::vector<Candidate>& cands)
+// How a search, or a part of it, came out. The search unwinds by returning
+// anything but Exhausted, rather than by throwing, so that each of the
+// threads searching its own subtrees can stop cleanly.
+enum SearchStatus {
+    Exhausted,    // searched to the end, or with nothing yet telling us to stop
+    Satisfied,    // the sink wants no more solutions
+    Interrupted,  // early_terminate told us to stop
+};
+
+namespace {
+// Where the solutions go, shared by every thread of a search, and by each
+// pass of a search that checkpoints and resumes. Without a visitor, the
+// first solution is the only one wanted.
+struct SolutionSink {
+    const SolutionVisitor *visitor = nullptr;
+    std::mutex mtx;
+    unsigned long long count = 0;
+    std::string first_message;
+    std::atomic<bool> done{false};  // no more solutions are wanted
+};
+} // anonymous namespace
+
+template<class Bits>
+static std::string mask_to_string(const Bits& m, int n);
+
+// Pass on a solution of t tests. Returns whether to keep searching.
+template<class Bits>
+static bool report_solution(SolutionSink& sink, const std::vector<Bits>& solution, int n, int t, const std::vector<Bits>& cands)
 {
+    std::lock_guard<std::mutex> lk(sink.mtx);
+    if (sink.done) {
+        // Another thread has already been told it's the last.
+        return false;
+    }
+    sink.count += 1;
+    bool keep_going = false;
+    if (sink.visitor != nullptr) {
+        std::vector<std::string> tests;
+        for (int i = 0; i < t; ++i) {
+            tests.push_back(mask_to_string(solution[i], n));
+        }
+        keep_going = (*sink.visitor)(tests);
+    }
+    if (!keep_going) {
+        sink.done = true;
+    }
+    if (sink.count != 1) {
+        return keep_going;
+    }
     std::string message;
     message += format("Awesome, I think I found a solution using %d blood tests!\n", t);
     message += format("  My %d tests use blood from the following sheep:\n", t);
@@ -105,7 +415,7 @@ static void report_solution(const std::vector<Int>& solution, int n, int t, cons
         message += format("  %d.%s", i+1, (i >= 9) ? "" : " ");
         auto m = solution[i];
         for (int sheep = 0; sheep < n; ++sheep) {
-            bool this_sheep_is_used = ((m & (Int(1) << sheep)) != 0);
+            bool this_sheep_is_used = ((m & (Bits(1) << sheep)) != 0);
             message += format(" %c", this_sheep_is_used ? 'T' : '.');
         }
         message += format("\n");
@@ -115,22 +425,26 @@ static void report_solution(const std::vector<Int>& solution, int n, int t, cons
     for (auto&& cand : cands) {
             message += format("Candidate wolves:");
             for (int i=0; i < n; ++i) {
-                bool sheep_is_wolf = (cand.is_wolf & (Int(1) << i)) != 0;
+                bool sheep_is_wolf = (cand & (Bits(1) << i)) != 0;
                 message += format(" %d", sheep_is_wolf ? 1 : 0);
             }
             message += format("   Test results: ");
             for (int i=0; i < t; ++i) {
-                bool test_was_positive = (cand.test_results & (Int(1) << i)) != 0;
+                bool test_was_positive = (solution[i] & cand) != 0;
                 message += format(" %c", test_was_positive ? '+' : '-');
             }
             message += format("\n");
     }
+#else
+    (void)cands;
 #endif
-    throw NktResult(true, message);
+    sink.first_message = std::move(message);
+    return keep_going;
 }
 
+template<class Bits>
 static inline
-Int increment(Int m, int i) {
+Bits increment(Bits m, int i) {
     if (i == 0) {
         m <<= 1;
     }
@@ -139,21 +453,102 @@ Int increment(Int m, int i) {
 }
 
 namespace {
-template<class A, class B>
+// The prefixes of tests that the shallow levels of the search have already
+// seen (and so searched, or are searching), up to permuting tests and animals.
+template<class Bits>
+struct SeenPrefixes {
+    std::unordered_set<std::string> forms;
+    size_t bytes = 0;
+    size_t budget = 0;
+#ifdef WOLVES_NAUTY
+    NautyWorkspace workspace;
+#endif
+
+    // Returns true if a permutation of tests[0..len) has been seen before.
+    // Otherwise, remembers this one if there's room.
+    bool seen_before(const std::vector<Bits>& tests, int len, int n) {
+#ifdef WOLVES_NAUTY
+        TestMatrix matrix(len, n);
+        for (int i = 0; i < len; ++i) {
+            for (int sheep = 0; sheep < n; ++sheep) {
+                if ((tests[i] & (Bits(1) << sheep)) != 0) {
+                    matrix.set(i, sheep, true);
+                }
+            }
+        }
+        TestMatrix canonical = canonicalize_with_nauty(matrix, workspace);
+        std::string form(reinterpret_cast<const char *>(canonical.row(0)),
+                         size_t(len) * canonical.words_per_row() * sizeof(uint64_t));
+        if (forms.count(form) != 0) {
+            return true;
+        }
+        // Roughly what a node of the hash table costs, besides the string itself.
+        const size_t cost = form.size() + 64;
+        if (bytes + cost <= budget) {
+            forms.insert(std::move(form));
+            bytes += cost;
+        }
+        return false;
+#else
+        (void)tests; (void)len; (void)n;
+        assert(!"isomorph rejection needs a build with nauty");
+        return false;
+#endif
+    }
+
+    void clear() {
+        forms.clear();
+        bytes = 0;
+    }
+};
+
+template<class Bits, class A, class B>
 struct TestingState {
-    std::vector<Candidate> cands;
-    std::vector<Int> solution;
-    std::vector<Int> partial_result_counts;
+    std::vector<Bits> cands;
+    std::vector<Bits> solution;
+    // The groups of candidates not yet distinguished from one another, bucketed by
+    // their results so far. Each level of the search pushes the finer groups it
+    // creates on top of its parent's; backtracking just pops them off again.
+    // Candidates that are already uniquely identified don't appear in any group.
+    std::vector<CandidateGroup> groups;
     A early_terminate;
     B test_is_acceptable;
+    LiveStats *stats = nullptr;
+    SolutionSink *sink = nullptr;
+
+    // When task_depth is reachable, attempt_testing doesn't recurse past it;
+    // instead it records each viable prefix of that length as a separate task.
+    int task_depth = INT_MAX;
+    std::vector<std::vector<Bits>> tasks;
+    // Meanwhile, the solutions shallower than that are kept here, not reported.
+    std::vector<std::vector<Bits>> shallow_solutions;
+
+    // When resuming from a checkpoint, each of the first resume_depth levels of
+    // the search starts at resume[i] instead of at the beginning.
+    std::vector<Bits> resume;
+    int resume_depth = 0;
+    // The level at which early_terminate last stopped the search.
+    int stopped_depth = 0;
+
+    // See SolveOptions::isomorph_rejection_depth.
+    int isomorph_depth = 0;
+    SeenPrefixes<Bits> seen;
+
+    // See SolveOptions::mask_order. Unless it's Numeric, each level gathers the
+    // tests open to it in ordered[i], each with its priority (lowest first),
+    // before trying any of them; balance[w] is the priority of weight w.
+    MaskOrder mask_order = MaskOrder::Numeric;
+    uint64_t seed = 0;
+    std::vector<uint64_t> balance;
+    std::vector<std::vector<std::pair<uint64_t, Bits>>> ordered;
 
     explicit TestingState(A a, B b) :
         early_terminate(std::move(a)), test_is_acceptable(std::move(b)) {}
 
     bool animals_in_same_group(int s1, int s2, int t) const {
         assert(s2 == s1 + 1);
-        Int mask = (Int(3) << s1);  // s1 and s2
-        Int okay_mask = (Int(1) << s1);  // s1 is present, s2 is not
+        Bits mask = (Bits(3) << s1);  // s1 and s2
+        Bits okay_mask = (Bits(1) << s1);  // s1 is present, s2 is not
         for (int i=0; i < t; ++i) {
             if ((solution[i] & mask) == okay_mask) {
                 return false;
@@ -164,14 +559,200 @@ struct TestingState {
 };
 } // anonymous namespace
 
-template<class A, class B>
-static void attempt_testing(TestingState<A, B>& state, int n, int i, int t) {
+// The size of the largest piece that test m would split any group in
+// [first_group, last_group) into; once a piece is larger than max_group_size,
+// the first such size found.
+template<class State, class Bits>
+static size_t largest_piece(const State& state, const Bits& m, size_t first_group, size_t last_group, Int max_group_size)
+{
+    const Bits *cands = state.cands.data();
+    size_t largest = 0;
+    for (size_t gi = first_group; gi < last_group; ++gi) {
+        const CandidateGroup g = state.groups[gi];
+        size_t wolfy = 0;
+        for (size_t j = g.begin; j < g.end; ++j) {
+            wolfy += ((m & cands[j]) != 0);
+        }
+        largest = std::max(largest, std::max(wolfy, (g.end - g.begin) - wolfy));
+        if (largest > max_group_size) {
+            return largest;
+        }
+    }
+    return largest;
+}
+
+// Split each group in [first_group, last_group) according to the result of test m,
+// pushing the non-singleton pieces onto state.groups. If any piece would be larger
+// than max_group_size, push nothing and return false.
+template<class State, class Bits>
+static bool refine_groups(State& state, const Bits& m, size_t first_group, size_t last_group, Int max_group_size)
+{
+    // Most tests are rejected, so check the sizes before rearranging anything.
+    if (largest_piece(state, m, first_group, last_group, max_group_size) > max_group_size) {
+        return false;
+    }
+    for (size_t gi = first_group; gi < last_group; ++gi) {
+        const CandidateGroup g = state.groups[gi];
+        auto first = state.cands.begin() + g.begin;
+        auto last = state.cands.begin() + g.end;
+        auto mid = std::partition(first, last, [&m](const Bits& cand) {
+            return (m & cand) != 0;
+        });
+        size_t wolfy = (mid - first);
+        if (wolfy >= 2) {
+            state.groups.push_back(CandidateGroup{g.begin, g.begin + wolfy});
+        }
+        if ((g.end - g.begin) - wolfy >= 2) {
+            state.groups.push_back(CandidateGroup{g.begin + wolfy, g.end});
+        }
+    }
+    return true;
+}
+
+// Size the scratch space for the worst case before searching, so that the search
+// itself never allocates. The groups at level i are disjoint and have at least two
+// candidates each, so there are at most min(2^i, cands/2) of them.
+template<class State>
+static void reserve_scratch(State& state, int t)
+{
+    const size_t max_groups_per_level = state.cands.size() / 2 + 1;
+    size_t max_groups = 0;
+    for (int i = 0; i <= t; ++i) {
+        max_groups += (i < 63) ? std::min(size_t(1) << i, max_groups_per_level) : max_groups_per_level;
+    }
+    state.groups.reserve(max_groups);
+    state.ordered.resize(t);
+}
+
+template<class Bits, class A, class B>
+static SearchStatus attempt_testing(TestingState<Bits, A, B>& state, int n, int i, int t, size_t first_group, size_t last_group);
+
+// Whether test m may come next at level i, by every rule but the information
+// bound (which needs the groups). Counts the reason for turning it down.
+template<class Bits, class A, class B>
+static inline
+bool mask_is_eligible(TestingState<Bits, A, B>& state, int n, int i, const Bits& m,
+                      const Bits& mask_so_far, int max_population, bool reordering)
+{
+    COUNT_STAT(state, masks, i);
+
+    if (!state.test_is_acceptable(m)) {
+        COUNT_STAT(state, pruned[PrunedUnacceptable], i);
+        return false;
+    }
+
+    if (!is_power_of_2_minus_1(mask_so_far | m)) {
+        // Testing the 6th animal when we haven't touched the 5th animal yet is pointless.
+        // Without loss of generality we can assume the animals are introduced in order.
+        COUNT_STAT(state, pruned[PrunedOutOfOrder], i);
+        return false;
+    }
+    if (popcount(m) > max_population) {
+        COUNT_STAT(state, pruned[PrunedByPopulation], i);
+        return false;
+    }
+
+    // The first isomorph_depth tests are whichever permutation of them we saw
+    // first, so nothing below can assume they were chosen in numerical order.
+    // All that's left is to keep the tests below them in order (heaviest first,
+    // as always, and then increasing); any repeat of a test is useless.
+    if (reordering && i != 0 && popcount(m) == max_population) {
+        bool repeat = (i > state.isomorph_depth && !(state.solution[i-1] < m));
+        for (int j = 0; j < i && !repeat; ++j) {
+            repeat = (state.solution[j] == m);
+        }
+        if (repeat) {
+            COUNT_STAT(state, pruned[PrunedByPopulation], i);
+            return false;
+        }
+    }
+
+    // Without loss of generality, we can keep the columns decreasing to the right.
+    // That is, if Sheeps 1 and 2 have been in the same test groups all the time
+    // up to this point, we should not introduce Sheep 2 into a new group unless Sheep 1
+    // is already there (but we might introduce Sheep 1 without Sheep 2).
+    for (int s2 = 1; s2 < n; ++s2) {
+        int s1 = s2 - 1;
+        bool sheep2_in_group = (m & (Bits(1) << s2)) != 0;
+        bool sheep1_in_group = (m & (Bits(1) << s1)) != 0;
+        if (sheep2_in_group && !sheep1_in_group) {
+            if (state.animals_in_same_group(s1, s2, i)) {
+                COUNT_STAT(state, pruned[PrunedByColumnOrder], i);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Perform test m at level i, and search on below it.
+template<class Bits, class A, class B>
+static inline
+SearchStatus try_mask(TestingState<Bits, A, B>& state, int n, int i, int t, const Bits& m,
+                      size_t first_group, size_t last_group, Int permissible_indistinguishable_cases)
+{
+    // Having performed this test, we want to make sure that it's still
+    // information-theoretically possible to distinguish so-far-identical
+    // cases in our remaining (t - i - 1) tests. Only the groups of
+    // so-far-identical cases need to be looked at; each one splits into
+    // the candidates for which test m is wolfy and those for which it isn't.
+    const size_t next_first_group = state.groups.size();
+    if (!refine_groups(state, m, first_group, last_group, permissible_indistinguishable_cases)) {
+        COUNT_STAT(state, pruned[PrunedByInformation], i);
+        return Exhausted;
+    }
+
+    state.solution[i] = m;
+    if (state.groups.size() == next_first_group) {
+        // Every candidate is now in a group by itself.
+        if (state.task_depth != INT_MAX) {
+            state.shallow_solutions.emplace_back(state.solution.begin(), state.solution.begin() + i+1);
+            return Exhausted;
+        }
+        return report_solution(*state.sink, state.solution, n, i+1, state.cands) ? Exhausted : Satisfied;
+    } else if (i < state.isomorph_depth && state.seen.seen_before(state.solution, i+1, n)) {
+        COUNT_STAT(state, pruned[PrunedAsIsomorph], i);
+        state.groups.resize(next_first_group);
+        return Exhausted;
+    } else {
+        SearchStatus status = attempt_testing(state, n, i+1, t, next_first_group, state.groups.size());
+        state.groups.resize(next_first_group);
+        return status;
+    }
+}
+
+// A seed for shuffling the tests at this node, the same each time the node is
+// visited, so that a resumed search retraces its steps.
+template<class Bits>
+static uint64_t node_seed(uint64_t seed, const std::vector<Bits>& solution, int i, int n)
+{
+    uint64_t h = mix64(seed);
+    for (int j = 0; j < i; ++j) {
+        for (int sheep = 0; sheep < n; ++sheep) {
+            if ((solution[j] & (Bits(1) << sheep)) != 0) {
+                h = mix64(h ^ (uint64_t(j) << 32 | uint64_t(sheep)));
+            }
+        }
+        h = mix64(h ^ uint64_t(j));
+    }
+    return h;
+}
+
+template<class Bits, class A, class B>
+static SearchStatus attempt_testing(TestingState<Bits, A, B>& state, int n, int i, int t, size_t first_group, size_t last_group) {
     assert(i < t);
     if (state.early_terminate()) {
-        throw EarlyTerminateException();
+        state.stopped_depth = i;
+        return Interrupted;
+    }
+    COUNT_STAT(state, nodes, i);
+
+    if (i == state.task_depth) {
+        state.tasks.emplace_back(state.solution.begin(), state.solution.begin() + i);
+        return Exhausted;
     }
 
-    Int mask_so_far = Int(0);
+    Bits mask_so_far = Bits(0);
     for (int j=0; j < i; ++j) mask_so_far |= state.solution[j];
 
     // Without loss of generality, we can assume that the tests are performed
@@ -183,169 +764,610 @@ static void attempt_testing(TestingState<A, B>& state, int n, int i, int t) {
     int animals_yet_to_test = (n - 1) - popcount(mask_so_far);
     int remaining_tests = (t - i);
     if (i != 0 && animals_yet_to_test > max_population * remaining_tests) {
-        return;
+        COUNT_STAT(state, pruned[PrunedByPigeonhole], i);
+        return Exhausted;
     }
 
-    Int starting_m = (i == 0) ? 1 : state.solution[i-1] + 1;
+    // Searched from scratch, each test can come numerically after the one before;
+    // with isomorph rejection, it can't (see mask_is_eligible).
+    const bool reordering = (state.isomorph_depth != 0);
+    Bits starting_m = (i == 0 || reordering) ? Bits(0) : state.solution[i-1];
+    ++starting_m;
+    Bits end_m = (Bits(1) << (n - 1));
+    --end_m;
 
     // Information theory tells us that, after this test is performed, if our tests
     // thus far have given identical results for more than 2^(remaining tests)
     // distinct candidate sets of wolves, then it's hopeless; we'll never distinguish
     // all of those sets in just (remaining tests) tests.
-    const Int permissible_indistinguishable_cases = Int(1) << (remaining_tests - 1);
+    const Int permissible_indistinguishable_cases =
+        (remaining_tests - 1 < 64) ? (Int(1) << (remaining_tests - 1)) : Int(-1);
 
-    for (Int m = starting_m; m < (Int(1) << (n - 1)) - 1; m = increment(m, i)) {
-
-        if (!state.test_is_acceptable(m)) {
-            continue;
+    if (state.mask_order == MaskOrder::Numeric) {
+        Bits m = starting_m;
+        if (i < state.resume_depth) {
+            // Everything before resume[i] was searched before the checkpoint was taken.
+            // Only the first m we try here resumes its subtree; the rest start afresh.
+            m = state.resume[i];
+        }
+        for ( ; m < end_m; m = increment(m, i), state.resume_depth = std::min(state.resume_depth, i)) {
+            if (mask_is_eligible(state, n, i, m, mask_so_far, max_population, reordering)) {
+                SearchStatus status = try_mask(state, n, i, t, m, first_group, last_group, permissible_indistinguishable_cases);
+                if (status != Exhausted) {
+                    return status;
+                }
+            }
         }
+        return Exhausted;
+    }
 
-        if (!is_power_of_2_minus_1(mask_so_far | m)) {
-            // Testing the 6th animal when we haven't touched the 5th animal yet is pointless.
-            // Without loss of generality we can assume the animals are introduced in order.
+    // Otherwise, gather up every test we could try here, and try them in order of priority.
+    auto& ordered = state.ordered[i];
+    ordered.clear();
+    uint64_t rng = node_seed(state.seed, state.solution, i, n);
+    for (Bits m = starting_m; m < end_m; m = increment(m, i)) {
+        if (!mask_is_eligible(state, n, i, m, mask_so_far, max_population, reordering)) {
             continue;
         }
-        if (popcount(m) > max_population) {
-            continue;
+        uint64_t priority = 0;
+        if (state.mask_order == MaskOrder::Balanced) {
+            priority = state.balance[popcount(m)];
+        } else if (state.mask_order == MaskOrder::Informative) {
+            priority = largest_piece(state, m, first_group, last_group, permissible_indistinguishable_cases);
+            if (priority > permissible_indistinguishable_cases) {
+                COUNT_STAT(state, pruned[PrunedByInformation], i);
+                continue;
+            }
+        } else {
+            rng = mix64(rng + 1);
+            priority = rng;
+        }
+        ordered.emplace_back(priority, m);
+    }
+    // Ties stay in numeric order.
+    std::stable_sort(ordered.begin(), ordered.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    // These searches never resume from a checkpoint (see SolveOptions::mask_order).
+    assert(i >= state.resume_depth);
+    for (auto&& entry : ordered) {
+        SearchStatus status = try_mask(state, n, i, t, entry.second, first_group, last_group, permissible_indistinguishable_cases);
+        if (status != Exhausted) {
+            return status;
         }
+    }
+    return Exhausted;
+}
 
-        // Without loss of generality, we can keep the columns decreasing to the right.
-        // That is, if Sheeps 1 and 2 have been in the same test groups all the time
-        // up to this point, we should not introduce Sheep 2 into a new group unless Sheep 1
-        // is already there (but we might introduce Sheep 1 without Sheep 2).
-        for (int s2 = 1; s2 < n; ++s2) {
-            int s1 = s2 - 1;
-            bool sheep2_in_group = (m & (Int(1) << s2)) != 0;
-            bool sheep1_in_group = (m & (Int(1) << s1)) != 0;
-            if (sheep2_in_group && !sheep1_in_group) {
-                if (state.animals_in_same_group(s1, s2, i)) {
-                    goto abandon_this_line;
-                }
-            }
+// What solve_wolves hands down to the search, besides the problem itself.
+struct SearchParams {
+    int num_threads;
+    const SolveCheckpoint *resume_from;
+    SolveCheckpoint *stopped_at;
+    SearchStats *stats;
+    int isomorph_depth;
+    size_t isomorph_memory_budget;
+    MaskOrder mask_order;
+    uint64_t seed;
+    SolutionSink *sink;
+};
+
+// A subtree of the search: its first fixed_depth tests are path[0..fixed_depth),
+// and below that the search resumes from the rest of path.
+template<class Bits>
+struct SearchTask {
+    int fixed_depth;
+    std::vector<Bits> path;
+};
+
+template<class Bits>
+static std::string mask_to_string(const Bits& m, int n)
+{
+    std::string result(n, '0');
+    for (int sheep = 0; sheep < n; ++sheep) {
+        if ((m & (Bits(1) << sheep)) != 0) {
+            result[sheep] = '1';
         }
-        if (false) {
-            abandon_this_line: continue;
+    }
+    return result;
+}
+
+template<class Bits>
+static Bits mask_from_string(const std::string& s)
+{
+    Bits m = Bits(0);
+    for (int sheep = 0; sheep < int(s.size()); ++sheep) {
+        if (s[sheep] == '1') {
+            m |= (Bits(1) << sheep);
         }
+    }
+    return m;
+}
 
-        // Having performed this test, we want to make sure that it's still
-        // information-theoretically possible to distinguish so-far-identical
-        // cases in our remaining (t - i - 1) tests.
+template<class Bits, class A, class B>
+static SearchStatus search_task(TestingState<Bits, A, B>& state, int n, int t, const SearchTask<Bits>& task)
+{
+    // Replay the fixed tests to rebuild the groups of candidates they leave indistinguishable.
+    state.groups.resize(1);
+    size_t first_group = 0;
+    size_t last_group = 1;
+    for (int j = 0; j < task.fixed_depth; ++j) {
+        state.solution[j] = task.path[j];
+        size_t next_first_group = state.groups.size();
+        bool ok = refine_groups(state, task.path[j], first_group, last_group, Int(-1));
+        assert(ok);
+        first_group = next_first_group;
+        last_group = state.groups.size();
+    }
+    state.resume = task.path;
+    state.resume_depth = task.path.size();
+    return attempt_testing(state, n, task.fixed_depth, t, first_group, last_group);
+}
 
-        bool these_tests_are_sufficient = true;
-        state.partial_result_counts.resize(Int(1) << (i + 1));
-        for (Int& count : state.partial_result_counts) {
-            count = 0;
+// After early_terminate stopped search_task, return the part of the task still to be searched.
+template<class Bits, class A, class B>
+static SearchTask<Bits> where_we_stopped(const TestingState<Bits, A, B>& state, const SearchTask<Bits>& task)
+{
+    SearchTask<Bits> result{task.fixed_depth, {}};
+    int depth = std::max(state.stopped_depth, state.resume_depth);
+    for (int j = 0; j < depth; ++j) {
+        result.path.push_back(j < state.stopped_depth ? state.solution[j] : state.resume[j]);
+    }
+    return result;
+}
+
+// Enumerate the shallowest level of the search tree that yields enough
+// independent subtrees to keep every thread busy. Each level tried finds the
+// solutions shallower than it all over again, so only the last one's are
+// reported, from here; without a visitor, the first one found stops us there.
+template<class Bits, class A, class B>
+static SearchStatus split_search(TestingState<Bits, A, B>& state, int n, int t, int num_threads,
+                                 std::vector<SearchTask<Bits>> *tasks)
+{
+    int depth = 0;
+    for (int d = 1; d < t && d <= 3; ++d) {
+        state.task_depth = d;
+        state.tasks.clear();
+        state.shallow_solutions.clear();
+        state.seen.clear();
+        if (attempt_testing(state, n, 0, t, 0, 1) == Interrupted) {
+            state.task_depth = INT_MAX;
+            return Interrupted;
+        }
+        depth = d;
+        if (state.tasks.empty() || state.tasks.size() >= 4 * size_t(num_threads) ||
+            (!state.shallow_solutions.empty() && state.sink->visitor == nullptr)) {
+            break;
+        }
+    }
+    state.task_depth = INT_MAX;
+    for (auto&& solution : state.shallow_solutions) {
+        if (!report_solution(*state.sink, solution, n, int(solution.size()), state.cands)) {
+            return Satisfied;
         }
+    }
+    for (auto&& prefix : state.tasks) {
+        tasks->push_back(SearchTask<Bits>{depth, std::move(prefix)});
+    }
+    state.tasks.clear();
+    return Exhausted;
+}
+
+template<class Bits, class A, class B>
+static SearchStatus search_tasks(TestingState<Bits, A, B>& state, int n, int t, const std::vector<SearchTask<Bits>>& tasks,
+                                 int num_threads, SearchStats *stats, std::vector<SearchTask<Bits>> *unfinished)
+{
+    // Threads pull subtrees from the shared list one at a time, so a thread that
+    // drew an easy subtree simply moves on to the next unclaimed one.
+    std::atomic<size_t> next_task(0);
+    std::atomic<bool> interrupted(false);
+    std::mutex mtx;
+    SolutionSink& sink = *state.sink;
 
-        // Suppose the i'th test (out of t tests total) combines blood from these sheep.
-        // What will the result of the test be, for each candidate arrangement of wolves?
-        for (auto& cand : state.cands) {
-            Int test_result = Int(0);
-            if (m & cand.is_wolf) {
-                test_result = Int(1) << i;
+    auto work = [&]() {
+        auto stop = [&]() {
+            return sink.done.load(std::memory_order_relaxed) || state.early_terminate();
+        };
+        TestingState<Bits, decltype(stop), B> local(stop, state.test_is_acceptable);
+        LiveStats live(stats);
+        local.stats = &live;
+        local.sink = &sink;
+        local.cands = state.cands;
+        local.groups = state.groups;
+        local.solution.resize(t);
+        reserve_scratch(local, t);
+        local.isomorph_depth = state.isomorph_depth;
+        local.seen.budget = state.seen.budget;
+        local.mask_order = state.mask_order;
+        local.seed = state.seed;
+        local.balance = state.balance;
+        for (size_t ti; (ti = next_task++) < tasks.size(); ) {
+            SearchStatus status = search_task(local, n, t, tasks[ti]);
+            if (status == Exhausted) {
+                continue;
             }
-            cand.test_results &= (Int(1) << i) - 1;  // clear all bits [i..t)
-            cand.test_results |= test_result;        // set bit [i] appropriately
-
-            assert(cand.test_results < state.partial_result_counts.size());
-            Int& count = state.partial_result_counts[cand.test_results];
-            count += 1;
-            if (count > permissible_indistinguishable_cases) {
-                goto abandon_this_line;
-            } else if (count > 1) {
-                these_tests_are_sufficient = false;
+            // Whoever stopped with the last solution wanted, the rest are done too.
+            if (status == Interrupted && !sink.done) {
+                std::lock_guard<std::mutex> lk(mtx);
+                interrupted = true;
+                unfinished->push_back(where_we_stopped(local, tasks[ti]));
             }
+            return;
         }
+    };
 
-        if (these_tests_are_sufficient) {
-            state.solution[i] = m;
-            report_solution(state.solution, n, i+1, state.cands);
-        } else {
-            state.solution[i] = m;
-            attempt_testing(state, n, i+1, t);
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_threads; ++i) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto&& th : threads) {
+        th.join();
+    }
+
+    if (sink.done) {
+        return Satisfied;
+    } else if (interrupted) {
+        for (size_t ti = next_task; ti < tasks.size(); ++ti) {
+            unfinished->push_back(tasks[ti]);
+        }
+        return Interrupted;
+    }
+    return Exhausted;
+}
+
+// Unless we're interrupted, *result gets the answer.
+template<class Bits, class A, class B>
+static SearchStatus search_for_solution(int n, int k, int t, const A& early_terminate, const B& test_is_acceptable,
+                                        const SearchParams& params, NktResult *result)
+{
+    std::vector<Bits> cands = make_candidates<Bits>(n, k);
+#if 0
+    for (auto&& cand : cands) {
+        printf("Candidate wolves:");
+        for (int i=0; i < n; ++i) {
+            bool sheep_is_wolf = (cand & (Bits(1) << i)) != 0;
+            printf(" %d", sheep_is_wolf ? 1 : 0);
+        }
+        printf("\n");
+    }
+#endif
+    TestingState<Bits, A, B> state(early_terminate, test_is_acceptable);
+    LiveStats live(params.stats);
+    state.stats = &live;
+    state.sink = params.sink;
+    state.cands = std::move(cands);
+    state.groups.push_back(CandidateGroup{0, state.cands.size()});
+    state.solution.resize(t);
+    reserve_scratch(state, t);
+    state.isomorph_depth = params.isomorph_depth;
+    state.seen.budget = params.isomorph_memory_budget;
+    state.mask_order = params.mask_order;
+    state.seed = params.seed;
+    // A test of w animals finds no wolf in a fraction C(n-w,k)/C(n,k) of the
+    // candidates; the closer that is to a half, the more the test tells us.
+    for (int w = 0; w <= n; ++w) {
+        double clean = 1.0;
+        for (int j = 0; j < k; ++j) {
+            clean *= std::max(0, n - w - j) / double(n - j);
+        }
+        state.balance.push_back(uint64_t(std::fabs(clean - 0.5) * double(uint64_t(1) << 52)));
+    }
+
+    // A checkpoint taken before the search got past split_search has a single
+    // entry, with nothing fixed and nowhere to resume: that's a fresh start.
+    const int num_threads = params.num_threads;
+    const SolveCheckpoint *resume_from = params.resume_from;
+    SolveCheckpoint *stopped_at = params.stopped_at;
+    bool fresh_start = (resume_from == nullptr) || (
+        resume_from->entries.size() == 1 &&
+        resume_from->entries[0].fixed_depth == 0 &&
+        resume_from->entries[0].path.empty()
+    );
+    std::vector<SearchTask<Bits>> tasks;
+    std::vector<SearchTask<Bits>> unfinished;
+    SearchStatus status = Exhausted;
+    if (!fresh_start) {
+        for (auto&& entry : resume_from->entries) {
+            SearchTask<Bits> task{entry.fixed_depth, {}};
+            for (auto&& m : entry.path) {
+                task.path.push_back(mask_from_string<Bits>(m));
+            }
+            tasks.push_back(std::move(task));
+        }
+    } else if (num_threads > 1) {
+        status = split_search(state, n, t, num_threads, &tasks);
+        if (status == Interrupted) {
+            unfinished.push_back(SearchTask<Bits>{0, {}});
         }
+    } else {
+        tasks.push_back(SearchTask<Bits>{0, {}});
+    }
+    if (status == Exhausted) {
+        status = search_tasks(state, n, t, tasks, num_threads, params.stats, &unfinished);
+    }
+    if (status == Interrupted) {
+        if (stopped_at != nullptr) {
+            stopped_at->entries.clear();
+            for (auto&& task : unfinished) {
+                SolveCheckpoint::Entry entry;
+                entry.fixed_depth = task.fixed_depth;
+                for (auto&& m : task.path) {
+                    entry.path.push_back(mask_to_string(m, n));
+                }
+                stopped_at->entries.push_back(std::move(entry));
+            }
+        }
+        return status;
+    }
+    // Earlier passes, before a checkpoint, may have found some too.
+    if (params.sink->count != 0) {
+        *result = NktResult(true, params.sink->first_message);
+    } else {
+        *result = NktResult(false,
+            format("I believe it's impossible to detect %d wolves among %d sheep in only %d tests.\n", k, n, t)
+        );
     }
+    return status;
 }
 
+// Unless we're interrupted, *result gets the answer.
 template<class A, class B>
-static NktResult solve_wolves_impl(int n, int k, int t, const A& early_terminate, const B& test_is_acceptable)
+static SearchStatus solve_wolves_impl(int n, int k, int t, const A& early_terminate, const B& test_is_acceptable,
+                                      const SearchParams& params, NktResult *result)
 {
     // k wolves hiding among n sheep, given t blood tests
 
     assert(n >= k && k >= 0);
     assert(t >= 0);
-    assert(t < sizeof(Int)*8);
 
-    Int nck = choose(n, k);
-    if (ceil_lg(nck) > t) {
-        return NktResult(false,
+    // A count that saturated is more than 2^64 (no C(n,k) with n <= 256 is
+    // exactly that), so it needs at least 65 tests.
+    Int nck = choose_saturated(n, k);
+    const bool saturated = (nck == ULLONG_MAX);
+    const int tests_needed = saturated ? 65 : ceil_lg(nck);
+    if (tests_needed > t) {
+        *result = NktResult(false,
             format(
                 "Sorry, information theory tells us that distinguishing %s possibilities requires %d > %d tests.\n",
-                std::to_string(nck).c_str(),
-                ceil_lg(nck), t
+                saturated ? "more than 2^64" : std::to_string(nck).c_str(),
+                tests_needed, t
             )
         );
+        return Exhausted;
     } else if (k == 0 || k == n) {
-        return NktResult(true,
+        *result = NktResult(true,
             format("We know %s of the sheep are wolves, so we don't need any tests!\n", (k == 0) ? "none" : "all")
         );
+        return Exhausted;
     } else if (t >= n-1) {
-        return NktResult(true,
+        *result = NktResult(true,
             format("We can obviously test %d sheep one-by-one using %d >= %d-1 blood tests!\n", n, t, n)
         );
+        return Exhausted;
     } else if (k == n-1) {
-        return NktResult(false,
+        *result = NktResult(false,
             format("Sorry, finding the one real sheep among %d wolves requires %d-1 > %d tests.\n", n, n, t)
         );
+        return Exhausted;
     } else if (k == 1) {
         assert(ceil_lg(n) <= t);
-        return NktResult(true,
+        *result = NktResult(true,
             format("We can test %d sheep for a lone wolf using the binary approach, in %d <= %d blood tests.\n", n, ceil_lg(n), t)
         );
+        return Exhausted;
     } else {
         // Okay, we have to do it for real.
-        std::vector<Candidate> cands = make_candidates(n, k);
-#if 0
-        for (auto&& cand : cands) {
-            printf("Candidate wolves:");
-            for (int i=0; i < n; ++i) {
-                bool sheep_is_wolf = (cand.is_wolf & (Int(1) << i)) != 0;
-                printf(" %d", sheep_is_wolf ? 1 : 0);
+        // Use the narrowest masks that can hold every animal.
+        assert(n <= 256);
+        if (n <= 64) {
+            return search_for_solution<Bits64>(n, k, t, early_terminate, test_is_acceptable, params, result);
+        } else if (n <= 128) {
+            return search_for_solution<Bits128>(n, k, t, early_terminate, test_is_acceptable, params, result);
+        } else {
+            return search_for_solution<Bits256>(n, k, t, early_terminate, test_is_acceptable, params, result);
+        }
+    }
+}
+
+namespace {
+// Sets a flag once the given number of seconds has passed, unless destroyed first.
+struct CheckpointTimer {
+    std::atomic<bool> due{false};
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool done = false;
+    std::thread th;
+
+    explicit CheckpointTimer(double seconds) {
+        if (seconds > 0) {
+            th = std::thread([this, seconds]() {
+                std::unique_lock<std::mutex> lk(mtx);
+                if (!cv.wait_for(lk, std::chrono::duration<double>(seconds), [&]() { return done; })) {
+                    due = true;
+                }
+            });
+        }
+    }
+
+    ~CheckpointTimer() {
+        if (th.joinable()) {
+            {
+                std::lock_guard<std::mutex> lk(mtx);
+                done = true;
             }
-            printf("\n");
+            cv.notify_one();
+            th.join();
         }
-#endif
-        TestingState<A, B> state(early_terminate, test_is_acceptable);
-        state.cands = std::move(cands);
-        state.solution.resize(t);
-        try {
-            attempt_testing(state, n, 0, t);
-        } catch (const NktResult& result) {
-            assert(result.success == true);
+    }
+};
+} // anonymous namespace
+
+NktResult solve_wolves(int n, int k, int t, const SolveOptions& options)
+{
+    if (options.resume_from != nullptr) {
+        assert(options.resume_from->n == n && options.resume_from->k == k && options.resume_from->t == t);
+        assert(options.resume_from->test_population == options.test_population);
+        assert(options.resume_from->isomorph_rejection_depth == options.isomorph_rejection_depth);
+    }
+    assert(options.isomorph_rejection_depth == 0 || solver_has_isomorph_rejection());
+    assert(options.mask_order == MaskOrder::Numeric || (options.resume_from == nullptr && !options.on_checkpoint));
+    // Starting again from scratch would find the same solutions again.
+    assert(!options.on_solution || options.mask_order != MaskOrder::Random || options.restart_nodes == 0);
+    auto user_wants_to_stop = [&]() { return options.early_terminate && options.early_terminate(); };
+    SolveCheckpoint resumed;
+    const SolveCheckpoint *resume_from = options.resume_from;
+    uint64_t seed = options.seed;
+    unsigned long long restart_budget = (options.mask_order == MaskOrder::Random) ? options.restart_nodes : 0;
+    SolutionSink sink;
+    sink.visitor = options.on_solution ? &options.on_solution : nullptr;
+
+    // A periodic checkpoint is just an early termination that we resume from
+    // straight away; it costs us the time to rebuild the candidate list.
+    // A restart is an early termination that we start again from scratch.
+    while (true) {
+        CheckpointTimer timer(options.on_checkpoint ? options.checkpoint_interval : 0);
+        std::atomic<unsigned long long> nodes(0);
+        auto out_of_nodes = [&]() {
+            return restart_budget != 0 && nodes.load(std::memory_order_relaxed) >= restart_budget;
+        };
+        auto early_terminate = [&]() {
+            // Every node of the search polls us exactly once.
+            if (restart_budget != 0 && nodes.fetch_add(1, std::memory_order_relaxed) >= restart_budget) {
+                return true;
+            }
+            return timer.due.load(std::memory_order_relaxed) || user_wants_to_stop();
+        };
+        SolveCheckpoint stopped_at;
+        stopped_at.n = n;
+        stopped_at.k = k;
+        stopped_at.t = t;
+        stopped_at.test_population = options.test_population;
+        stopped_at.isomorph_rejection_depth = options.isomorph_rejection_depth;
+        SearchParams params{options.num_threads, resume_from, &stopped_at, options.stats,
+                            options.isomorph_rejection_depth, options.isomorph_memory_budget,
+                            options.mask_order, seed, &sink};
+        NktResult result(false, "");
+        SearchStatus status;
+        if (options.test_population != 0) {
+            int s = options.test_population;
+            auto test_is_acceptable = [s](const auto& m) { return popcount(m) == s; };
+            status = solve_wolves_impl(n, k, t, early_terminate, test_is_acceptable, params, &result);
+        } else {
+            auto test_is_acceptable = [](const auto&) { return true; };
+            status = solve_wolves_impl(n, k, t, early_terminate, test_is_acceptable, params, &result);
+        }
+        if (status != Interrupted) {
+            result.solutions = sink.count;
             return result;
         }
-        return NktResult(false,
-            format("I believe it's impossible to detect %d wolves among %d sheep in only %d tests.\n", k, n, t)
-        );
+        if (out_of_nodes() && !user_wants_to_stop()) {
+            seed += 1;
+            restart_budget *= 2;
+            continue;
+        }
+        if (options.on_checkpoint) {
+            options.on_checkpoint(stopped_at);
+        }
+        if (!timer.due || user_wants_to_stop()) {
+            throw EarlyTerminateException();
+        }
+        resumed = std::move(stopped_at);
+        resume_from = &resumed;
     }
 }
 
+NktResult solve_wolves_portfolio(int n, int k, int t, const std::vector<SolveOptions>& members)
+{
+    assert(!members.empty());
+    std::atomic<bool> done(false);
+    std::mutex mtx;
+    bool found = false;
+    NktResult result(false, "");
+
+    auto run = [&](SolveOptions options) {
+        assert(!options.on_solution);
+        // A member that loses the race has nothing worth checkpointing.
+        std::function<bool()> own_terminate = std::move(options.early_terminate);
+        options.early_terminate = [&done, own_terminate]() {
+            return done.load(std::memory_order_relaxed) || (own_terminate && own_terminate());
+        };
+        if (options.on_checkpoint) {
+            std::function<void(const SolveCheckpoint&)> own_checkpoint = std::move(options.on_checkpoint);
+            options.on_checkpoint = [&done, own_checkpoint](const SolveCheckpoint& c) {
+                if (!done) own_checkpoint(c);
+            };
+        }
+        try {
+            NktResult r = solve_wolves(n, k, t, options);
+            std::lock_guard<std::mutex> lk(mtx);
+            if (!found) {
+                result = std::move(r);
+                found = true;
+                done = true;
+            }
+        } catch (const EarlyTerminateException&) {
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < members.size(); ++i) {
+        threads.emplace_back(run, members[i]);
+    }
+    run(members[0]);
+    for (auto&& th : threads) {
+        th.join();
+    }
+    if (!found) {
+        throw EarlyTerminateException();
+    }
+    return result;
+}
+
+bool parse_mask_order(const std::string& name, MaskOrder *order)
+{
+    for (MaskOrder o : {MaskOrder::Numeric, MaskOrder::Balanced, MaskOrder::Informative, MaskOrder::Random}) {
+        if (name == mask_order_name(o)) {
+            *order = o;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *mask_order_name(MaskOrder order)
+{
+    switch (order) {
+        case MaskOrder::Numeric: return "numeric";
+        case MaskOrder::Balanced: return "balanced";
+        case MaskOrder::Informative: return "informative";
+        case MaskOrder::Random: return "random";
+    }
+    return "?";
+}
+
+bool solver_has_isomorph_rejection()
+{
+#ifdef WOLVES_NAUTY
+    return true;
+#else
+    return false;
+#endif
+}
+
 NktResult solve_wolves(int n, int k, int t)
 {
-    auto early_terminate = []() { return false; };
-    auto test_is_acceptable = [](Int) { return true; };
-    return solve_wolves_impl(n, k, t, early_terminate, test_is_acceptable);
+    return solve_wolves(n, k, t, SolveOptions());
 }
 
 NktResult solve_wolves(int n, int k, int t, int s)
 {
-    auto early_terminate = []() { return false; };
-    auto test_is_acceptable = [s](Int m) { return popcount(m) == s; };
-    return solve_wolves_impl(n, k, t, early_terminate, test_is_acceptable);
+    SolveOptions options;
+    options.test_population = s;
+    return solve_wolves(n, k, t, options);
 }
 
 NktResult solve_wolves(int n, int k, int t, std::function<bool()> early_terminate)
 {
-    auto test_is_acceptable = [](Int) { return true; };
-    return solve_wolves_impl(n, k, t, early_terminate, test_is_acceptable);
+    SolveOptions options;
+    options.early_terminate = std::move(early_terminate);
+    return solve_wolves(n, k, t, options);
 }
@@ -1,16 +1,149 @@
 #pragma once
 
 #include <functional>
+#include <stddef.h>
+#include <stdint.h>
 #include <string>
+#include <vector>
 
 struct EarlyTerminateException {};
 
 struct NktResult {
     bool success;
     std::string message;
+    // With SolveOptions::on_solution, how many solutions were passed to it.
+    unsigned long long solutions = 0;
     explicit NktResult(bool success, std::string msg) : success(success), message(std::move(msg)) {}
 };
 
+// Receives a solution as its tests, each written as a string of n '0's and
+// '1's as in SolveCheckpoint; there may be fewer than t of them, if fewer
+// were enough. Returns whether the search should go on looking for more.
+using SolutionVisitor = std::function<bool(const std::vector<std::string>& tests)>;
+
+// Where a stopped search got to, so that solve_wolves can pick it back up. Each
+// entry is a subtree still to be searched: its first fixed_depth tests are
+// path[0..fixed_depth), and below that the search resumes at path[fixed_depth..]
+// instead of starting from scratch. Each test is written as a string of n '0's
+// and '1's, one per animal. A checkpoint with no entries has nothing left to search.
+struct SolveCheckpoint {
+    struct Entry {
+        int fixed_depth = 0;
+        std::vector<std::string> path;
+    };
+    int n = 0;
+    int k = 0;
+    int t = 0;
+    int test_population = 0;
+    int isomorph_rejection_depth = 0;
+    std::vector<Entry> entries;
+};
+
+// What the search did, level by level. The counters are only gathered when
+// wolves.cpp is built with -DWOLVES_STATS ("make STATS=1"); otherwise they
+// compile out entirely and stay zero.
+enum PruneReason {
+    PrunedByPigeonhole,   // whole nodes: too many animals left for the tests left
+    PrunedUnacceptable,   // masks rejected by test_population
+    PrunedOutOfOrder,     // masks that skip over an animal (is_power_of_2_minus_1)
+    PrunedByPopulation,   // masks heavier than the previous test (max_population),
+                          // or with isomorph rejection, repeating or out of order among equally heavy ones
+    PrunedByColumnOrder,  // masks that swap two interchangeable animals (animals_in_same_group)
+    PrunedByInformation,  // masks leaving too many candidates indistinguishable
+    PrunedAsIsomorph,     // masks making a permutation of a prefix already searched
+    NumPruneReasons
+};
+
+struct SearchStats {
+    static constexpr int max_depth = 32;  // deeper levels are lumped in with the last one
+    unsigned long long nodes[max_depth] = {};  // calls to attempt_testing
+    unsigned long long masks[max_depth] = {};  // tests considered
+    unsigned long long pruned[NumPruneReasons][max_depth] = {};
+
+    SearchStats& operator+=(const SearchStats& rhs);
+    SearchStats& operator-=(const SearchStats& rhs);
+    unsigned long long total_nodes() const;
+};
+
+// Everything counted so far in this process, including searches still running.
+SearchStats search_stats_so_far();
+
+// A table of the counters, one row per depth, plus the rate at which nodes
+// were visited if the stats took this many seconds to gather.
+std::string format_search_stats(const SearchStats& stats, double seconds);
+
+// The order in which each level of the search tries the tests open to it. It
+// doesn't change which tests are tried, only how soon, so a cell comes out the
+// same either way; but a solvable cell may be solved far sooner in one order
+// than in another.
+enum class MaskOrder {
+    Numeric,      // plain increasing order
+    Balanced,     // tests whose weight makes about half of all arrangements wolfy, first
+    Informative,  // tests that leave the smallest largest group of indistinguishable candidates, first
+    Random,       // a shuffle, different for each seed
+};
+
+// "numeric", "balanced", "informative" or "random" to a MaskOrder; false if it's none of those.
+bool parse_mask_order(const std::string& name, MaskOrder *order);
+const char *mask_order_name(MaskOrder order);
+
+struct SolveOptions {
+    // Split the top of the search tree into subtrees and search them on this many threads.
+    int num_threads = 1;
+    // If nonzero, every test must use blood from exactly this many animals.
+    int test_population = 0;
+    // Polled during the search; if it ever returns true, we throw EarlyTerminateException.
+    std::function<bool()> early_terminate;
+    // If set, search only what this checkpoint (for the same n, k, t and test_population) has left.
+    // A checkpoint written by a single-threaded search is resumed single-threaded.
+    const SolveCheckpoint *resume_from = nullptr;
+    // If set, called with the search's position just before early_terminate makes us
+    // throw EarlyTerminateException, and also every checkpoint_interval seconds.
+    std::function<void(const SolveCheckpoint&)> on_checkpoint;
+    double checkpoint_interval = 0;
+    // If set, this solve's counters are added to it.
+    SearchStats *stats = nullptr;
+    // If set, each solution found is passed to it, and the search goes on for as
+    // long as it returns true, instead of stopping at the first. A search that
+    // runs to the end has seen every solution but those its symmetry breaking
+    // rules out: they're distinct, though some may still be isomorphic to others
+    // (unless the isomorph rejection goes all the way down). The message is about
+    // the first solution. From more than one thread, the calls are one at a time;
+    // from a checkpoint, the solutions found before it are not seen again. The
+    // cells answered without a search (such as k == 1, or t >= n-1) have no
+    // solutions to pass, and a search with restarts may not have a visitor.
+    SolutionVisitor on_solution;
+    // If nonzero, the first this many levels of the search skip any prefix of tests
+    // that is a permutation (of tests and of animals) of one already searched, since
+    // it can be finished exactly when that one can. The ordering rules that assume a
+    // search from scratch are relaxed to make room: the tests still never get heavier,
+    // but only below these levels are equally heavy tests kept in increasing order.
+    // Each thread remembers the prefixes it has seen in up to isomorph_memory_budget
+    // bytes; once that's full, it simply searches any newcomers again.
+    // Only a solver built with nauty ("make NAUTY=1") can do this, and with more
+    // than one thread, only if nauty is thread-safe (configured with --enable-tls).
+    int isomorph_rejection_depth = 0;
+    size_t isomorph_memory_budget = size_t(256) << 20;
+    // Checkpoints are only taken of, and resumed into, MaskOrder::Numeric searches.
+    MaskOrder mask_order = MaskOrder::Numeric;
+    uint64_t seed = 0;
+    // If nonzero, a MaskOrder::Random search gives up after visiting this many
+    // nodes and starts again from scratch with the next seed, allowing itself
+    // twice as many nodes each time, until one attempt finishes.
+    unsigned long long restart_nodes = 0;
+};
+
+// Whether this build supports SolveOptions::isomorph_rejection_depth.
+bool solver_has_isomorph_rejection();
+
+NktResult solve_wolves(int n, int k, int t, const SolveOptions& options);
+
+// Search the same cell under each of these options at once, each on its own
+// num_threads threads, and return the answer of whichever finishes first; the
+// others are stopped. Throws EarlyTerminateException if every one of them was
+// stopped by its own early_terminate instead. None of them may have an on_solution.
+NktResult solve_wolves_portfolio(int n, int k, int t, const std::vector<SolveOptions>& members);
+
 NktResult solve_wolves(int n, int k, int t);
 NktResult solve_wolves(int n, int k, int t, std::function<bool()> early_terminate);
 